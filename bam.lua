@@ -12,6 +12,7 @@ AddTool(function(s)
 	s.link.libs:Add("GLU")
 	s.link.libs:Add("GLEW")
 	s.link.libs:Add("glfw")
+	s.link.libs:Add("pthread")
 	s.cc.includes:Add(src_dir)
 
 	s.cc.Output = function(s, input)
@@ -1,7 +1,57 @@
 #version 450 core
 
 layout(local_size_x = 8, local_size_y = 8) in;
-layout(rgba32f, binding = 0) uniform restrict writeonly image2D output_image;
+layout(rgba32f, binding = 0) uniform restrict image2D output_image;
+layout(rgba32f, binding = 1) uniform restrict image2D gbuffer_image; // normal, hit distance or -1
+
+// pixels selected for antialiasing, with the indirect dispatch arguments to refine them
+layout(std430, binding = 0) restrict buffer AaList {
+	uint aa_groups_x;
+	uint aa_groups_y;
+	uint aa_groups_z;
+	uint aa_count;
+	uint aa_refined;
+	uint aa_pixels[];
+};
+
+// per prune_tile_size square tile, the scene terms each march segment needs. one byte per segment
+layout(std430, binding = 1) restrict readonly buffer TileMasks {
+	uint tile_masks[];
+};
+
+// slots of the resident level chunks, see LevelView. every slot: primitive offset, count, brick offset, count
+layout(std430, binding = 2) restrict readonly buffer LevelChunks {
+	uvec4 level_chunks[];
+};
+
+// pos.w: 0 rounded box with half size size.xyz and rounding size.w, 1 sphere with radius size.w
+struct LevelPrimitive {
+	vec4 pos;
+	vec4 size;
+};
+
+layout(std430, binding = 3) restrict readonly buffer LevelPrimitives {
+	LevelPrimitive level_primitives[];
+};
+
+// cube of resolution^3 distance samples. samples: offset, resolution
+struct LevelBrick {
+	vec4 lo_size;
+	uvec4 samples;
+};
+
+layout(std430, binding = 4) restrict readonly buffer LevelBricks {
+	LevelBrick level_bricks[];
+};
+
+layout(std430, binding = 5) restrict readonly buffer LevelSamples {
+	float level_samples[];
+};
+
+// coordinates of the resident chunks and their slots in w, hashed like LevelView::table
+layout(std430, binding = 6) restrict readonly buffer LevelTable {
+	ivec4 level_table[];
+};
 
 uniform ivec2 render_translation;
 uniform ivec2 render_size;
@@ -11,6 +61,11 @@ uniform ivec2 mouse_coord;
 uniform vec3 camera_pos;
 uniform vec3 camera_dir;
 uniform int camera_player;
+uniform int aa_pass; // 0: march and fill gbuffer, 1: detect edges, 2: refine edges
+uniform bool tile_pruning;
+uniform int prune_tile_size;
+uniform bool level_loaded; // replaces the arena
+uniform float level_chunk_size;
 
 struct Player {
 	vec4 pos;
@@ -20,7 +75,31 @@ struct Player {
 
 uniform Player players[4];
 
+// per frame invariants of the players in scene(), prepared on the cpu
+struct Entity {
+	mat3 to_local;
+	vec3 pos;
+	vec4 extents;
+	bool enabled;
+};
+
+uniform Entity entities[4];
+
 #define pi 3.141
+#define aa_depth_threshold .1
+#define aa_normal_threshold .9
+
+// terms of scene(), bits 0 to 3 are the players
+#define scene_box 16u
+#define scene_floor 32u
+#define scene_arena 48u
+#define scene_level 64u
+#define scene_all 127u
+
+#define march_segments 8
+#define march_distance 20.
+
+uint march_masks[march_segments] = uint[](scene_all, scene_all, scene_all, scene_all, scene_all, scene_all, scene_all, scene_all);
 
 mat3 look_at(vec3 d)
 {
@@ -119,21 +198,107 @@ float pickerick(vec3 p)
 	return min(max(pickle, -mouth), min(eyeball, eyebrow)) * .8;
 }
 
-float scene(vec3 p)
+float level_primitive(vec3 p, LevelPrimitive q)
+{
+	if (q.pos.w == 0.)
+		return roundcube(p - q.pos.xyz, q.size);
+	return sphere(p - q.pos.xyz, q.size.w);
+}
+
+// trilinear interpolation of the baked samples, the distance to the brick outside of it
+float level_brick(vec3 p, LevelBrick b)
+{
+	vec3 half_size = vec3(b.lo_size.w * .5);
+	float outside = cube(p - b.lo_size.xyz - half_size, half_size);
+	if (outside > 0.)
+		return outside;
+
+	uint n = b.samples.y;
+	vec3 g = clamp((p - b.lo_size.xyz) / b.lo_size.w * float(n - 1u), vec3(0), vec3(float(n - 1u) - .001));
+	uvec3 i = uvec3(g);
+	vec3 f = g - vec3(i);
+	uint o = b.samples.x + i.x + n * (i.y + n * i.z);
+	float c00 = mix(level_samples[o], level_samples[o + 1u], f.x);
+	float c10 = mix(level_samples[o + n], level_samples[o + n + 1u], f.x);
+	float c01 = mix(level_samples[o + n * n], level_samples[o + n * n + 1u], f.x);
+	float c11 = mix(level_samples[o + n * n + n], level_samples[o + n * n + n + 1u], f.x);
+	return mix(mix(c00, c10, f.y), mix(c01, c11, f.y), f.z);
+}
+
+// slot of the resident chunk at coord, or -1. see LevelView::find
+int level_slot(ivec3 coord)
+{
+	uvec3 c = uvec3(coord);
+	uint mask = uint(level_table.length()) - 1u;
+	uint i = (c.x * 73856093u ^ c.y * 19349663u ^ c.z * 83492791u) & mask;
+	for (uint n = 0u; n <= mask; ++n, i = (i + 1u) & mask) {
+		if (level_table[i].w < 0 || level_table[i].xyz == coord)
+			return level_table[i].w;
+	}
+	return -1;
+}
+
+// distance to the content of one chunk if it is resident and closer than d
+float level_chunk(vec3 p, ivec3 coord, float d)
+{
+	int slot = level_slot(coord);
+	if (slot < 0)
+		return d;
+
+	uvec4 chunk = level_chunks[slot];
+	for (uint i = 0u; i < chunk.y; ++i)
+		d = min(d, level_primitive(p, level_primitives[chunk.x + i]));
+	for (uint i = 0u; i < chunk.w; ++i)
+		d = min(d, level_brick(p, level_bricks[chunk.z + i]));
+	return d;
+}
+
+// every primitive lies inside its chunk, so the chunks around p are enough for a distance bound.
+// the chunk of p goes first, then only the neighbours closer than the distance so far
+float level(vec3 p)
+{
+	float size = level_chunk_size;
+	ivec3 c = ivec3(floor(p / size));
+	vec3 f = p - vec3(c) * size;
+	float d = level_chunk(p, c, size);
+
+	ivec3 lo = ivec3(f.x < d ? -1 : 0, f.y < d ? -1 : 0, f.z < d ? -1 : 0);
+	ivec3 hi = ivec3(f.x > size - d ? 1 : 0, f.y > size - d ? 1 : 0, f.z > size - d ? 1 : 0);
+	vec3 half_size = vec3(size * .5);
+	for (int z = lo.z; z <= hi.z; ++z) {
+		for (int y = lo.y; y <= hi.y; ++y) {
+			for (int x = lo.x; x <= hi.x; ++x) {
+				ivec3 o = ivec3(x, y, z);
+				if (o != ivec3(0) && cube(p - vec3(c + o) * size - half_size, half_size) < d)
+					d = level_chunk(p, c + o, d);
+			}
+		}
+	}
+	return d;
+}
+
+float scene(vec3 p, uint mask)
 {
 	float c0 = 100.;
 	for (int i = 0; i < 4; ++i) {
-		if (camera_player != i && players[i].pos.w == 1) {
-			vec3 d = vec3(players[i].dir.x, 0, players[i].dir.z) * .5;
-			float dl = .5 - clamp(-players[i].dir.y * .7, 0, .5);
-			vec3 cp = inverse(look_at(normalize(d))) * (p - players[i].pos.xyz);
+		if ((mask & 1u << i) != 0u && camera_player != i && entities[i].enabled) {
+			vec3 cp = entities[i].to_local * (p - entities[i].pos);
 			// cp.x += length(players[i].vel) * 10. * sin(cp.z * 5. + elapsed_time) * .05;
-			c0 = min(c0, roundcube(cp, vec4(max(.05, dl), .5, .5, .05)));
+			c0 = min(c0, roundcube(cp, entities[i].extents));
 		}
 	}
 
-	float c1 = quickcube(p, vec3(5, .5, 5));
-	c1 = max(-c1, -plane(p, normalize(vec3(0, -1, 0)), .0));
+	float c1 = 100.;
+	if (level_loaded) {
+		if ((mask & scene_level) != 0u)
+			c1 = level(p);
+	} else if ((mask & scene_arena) != 0u) {
+		c1 = -100.;
+		if ((mask & scene_box) != 0u)
+			c1 = max(c1, -quickcube(p, vec3(5, .5, 5)));
+		if ((mask & scene_floor) != 0u)
+			c1 = max(c1, -plane(p, normalize(vec3(0, -1, 0)), .0));
+	}
 
 	return min(c0, c1) * .5;
 
@@ -153,20 +318,26 @@ float scene(vec3 p)
 	// return t0;
 }
 
+float scene(vec3 p)
+{
+	return scene(p, scene_all);
+}
+
 bool march(vec3 ro, vec3 rd, out vec3 p, out float steps)
 {
 	p = ro;
 	float ol = 0.;
 
 	for (int i = 0; i < 200; ++i) {
-		float l = scene(p);
+		int segment = clamp(int(ol * (march_segments / march_distance)), 0, march_segments - 1);
+		float l = scene(p, march_masks[segment]);
 		ol += l;
 		p = ro + rd * ol;
 		steps = float(i) / 100.;
 
 		if (l < .01)
 			return true;
-		if (ol > 20.)
+		if (ol > march_distance)
 			return false;
 	}
 
@@ -187,14 +358,11 @@ vec3 normal(vec3 p)
 	);
 }
 
-void main() {
-	vec2 output_size = min(render_size, vec2(imageSize(output_image) - render_translation));
-  vec2 output_coord = gl_GlobalInvocationID.xy;
-	if (output_coord.x >= output_size.x || output_coord.y >= output_size.y) return;
-
+vec3 pixel(vec2 output_coord, vec2 output_size, out vec4 gbuffer)
+{
 	vec2 uv = (output_coord - output_size * .5) / output_size.y;
 	vec3 c = vec3(0);
-  vec2 m = vec2(mouse_coord - output_size * .5) / output_size.y;
+	vec2 m = vec2(mouse_coord - output_size * .5) / output_size.y;
 
 	// m *= -pi;
 	// vec3 ro = vec3(sin(m.x) * cos(m.y), sin(m.y), cos(m.x) * cos(m.y)) * 3.;
@@ -214,5 +382,83 @@ void main() {
 	// if (hit)
 	// 	c *= march(p + n * .003, normalize(vec3(5, 4, 3) - p), p, steps) ? .6 : 1.;
 
+	gbuffer = hit ? vec4(n, length(p - ro)) : vec4(0, 0, 0, -1);
+	return c;
+}
+
+// hit/miss transition, depth discontinuity or diverging normals
+bool edge(vec4 a, vec4 b)
+{
+	if ((a.w < 0.) != (b.w < 0.))
+		return true;
+	if (a.w < 0.)
+		return false;
+	if (abs(a.w - b.w) > aa_depth_threshold * min(a.w, b.w))
+		return true;
+	return dot(a.xyz, b.xyz) < aa_normal_threshold;
+}
+
+// average the first sample with four more on a rotated grid
+vec3 refine(vec2 output_coord, vec2 output_size, vec3 c)
+{
+	const vec2 offsets[4] = vec2[](vec2(.125, .375), vec2(.375, -.125), vec2(-.125, -.375), vec2(-.375, .125));
+	vec4 gbuffer;
+	for (int i = 0; i < 4; ++i)
+		c += pixel(output_coord + offsets[i], output_size, gbuffer);
+	return c / 5.;
+}
+
+void load_march_masks(ivec2 coord, vec2 output_size)
+{
+	for (int s = 0; s < march_segments; ++s)
+		march_masks[s] = scene_all;
+	if (!tile_pruning)
+		return;
+
+	uint tiles_x = (uint(output_size.x) + uint(prune_tile_size) - 1u) / uint(prune_tile_size);
+	uint i = (uint(coord.y / prune_tile_size) * tiles_x + uint(coord.x / prune_tile_size)) * 2u;
+	for (int s = 0; s < march_segments; ++s)
+		march_masks[s] = tile_masks[i + uint(s / 4)] >> uint(s % 4 * 8) & 0xffu;
+}
+
+void main() {
+	vec2 output_size = min(render_size, vec2(imageSize(output_image) - render_translation));
+
+	if (aa_pass == 2) {
+		uint i = gl_WorkGroupID.x * 64u + gl_LocalInvocationIndex;
+		if (i >= aa_count) return;
+		ivec2 coord = ivec2(aa_pixels[i] & 0xffffu, aa_pixels[i] >> 16u);
+		vec3 c = imageLoad(output_image, render_translation + coord).rgb;
+		load_march_masks(coord, output_size);
+		imageStore(output_image, render_translation + coord, vec4(refine(coord, output_size, c), 1));
+		return;
+	}
+
+  vec2 output_coord = gl_GlobalInvocationID.xy;
+	if (output_coord.x >= output_size.x || output_coord.y >= output_size.y) return;
+
+	if (aa_pass == 1) {
+		ivec2 coord = ivec2(output_coord);
+		vec4 g = imageLoad(gbuffer_image, render_translation + coord);
+		const ivec2 neighbours[4] = ivec2[](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1), ivec2(0, 1));
+		bool e = false;
+		for (int i = 0; i < 4; ++i) {
+			ivec2 n = clamp(coord + neighbours[i], ivec2(0), ivec2(output_size) - 1);
+			e = e || edge(g, imageLoad(gbuffer_image, render_translation + n));
+		}
+		if (e) {
+			uint i = atomicAdd(aa_count, 1u);
+			aa_pixels[i] = uint(coord.x) | uint(coord.y) << 16u;
+			atomicMax(aa_groups_x, i / 64u + 1u);
+			atomicAdd(aa_refined, 1u);
+		}
+		return;
+	}
+
+	load_march_masks(ivec2(output_coord), output_size);
+	vec4 gbuffer;
+	vec3 c = pixel(output_coord, output_size, gbuffer);
+
 	imageStore(output_image, render_translation + ivec2(output_coord), vec4(c, 1));
+	imageStore(gbuffer_image, render_translation + ivec2(output_coord), gbuffer);
 }
@@ -0,0 +1,109 @@
+#include "cpurenderer.hpp"
+#include "misc.hpp"
+
+CpuRenderer::CpuRenderer(unsigned thread_count)
+	: m_pool(thread_count)
+{
+}
+
+unsigned CpuRenderer::render(const Rays& rays, glm::uvec2 output_size, std::vector<glm::vec4>& image, unsigned image_width)
+{
+	m_gbuffer.resize(output_size.x * output_size.y);
+	auto translation = glm::uvec2(rays.render_translation);
+	auto pixel = [&] (glm::uvec2 coord) -> glm::vec4& {
+		coord += translation;
+		return image[coord.y * image_width + coord.x];
+	};
+	auto gbuffer = [&] (glm::uvec2 coord) -> glm::vec4& {
+		return m_gbuffer[coord.y * output_size.x + coord.x];
+	};
+
+	// every tile marches with its own copy of the context, holding the pruned scene
+	auto tiles = (output_size + tile_size - 1u) / tile_size;
+	m_tile_rays.assign(tiles.x * tiles.y, rays);
+	auto tile_rays = [&] (glm::uvec2 coord) -> const Rays& {
+		coord /= tile_size;
+		return m_tile_rays[coord.y * tiles.x + coord.x];
+	};
+
+	auto for_each_tile = [&] (auto f) {
+		m_pool.parallel(tiles.x * tiles.y, [&] (unsigned tile) {
+			auto begin = glm::uvec2(tile % tiles.x, tile / tiles.x) * tile_size;
+			auto end = glm::min(begin + tile_size, output_size);
+			f(tile, begin, end);
+		});
+	};
+
+	auto for_each_pixel = [&] (auto f) {
+		for_each_tile([&] ([[maybe_unused]] unsigned tile, glm::uvec2 begin, glm::uvec2 end) {
+			for (auto y = begin.y; y < end.y; ++y)
+				for (auto x = begin.x; x < end.x; ++x)
+					f(glm::uvec2(x, y));
+		});
+	};
+
+	for_each_tile([&] (unsigned tile, glm::uvec2 begin, glm::uvec2 end) {
+		auto& context = m_tile_rays[tile];
+		if (m_tile_pruning)
+			context.prune_tile(glm::vec2(begin), glm::vec2(end - 1u), glm::vec2(output_size));
+		for (auto y = begin.y; y < end.y; ++y) {
+			for (auto x = begin.x; x < end.x; ++x) {
+				auto coord = glm::uvec2(x, y);
+				auto c = context.pixel(glm::vec2(coord), glm::vec2(output_size), &gbuffer(coord));
+				pixel(coord) = glm::vec4(c, 1);
+			}
+		}
+	});
+
+	if (!m_antialiasing)
+		return 0;
+
+	// collect edge pixels into a compact list
+	m_aa_pixels.resize(output_size.x * output_size.y);
+	auto aa_count = std::atomic<unsigned>(0);
+	for_each_pixel([&] (glm::uvec2 coord) {
+		const glm::ivec2 neighbours[4] = {{-1, 0}, {1, 0}, {0, -1}, {0, 1}};
+		auto g = gbuffer(coord);
+		auto e = false;
+		for (auto& neighbour : neighbours) {
+			auto n = glm::clamp(glm::ivec2(coord) + neighbour, glm::ivec2(0), glm::ivec2(output_size) - 1);
+			e = e || rays.edge(g, gbuffer(glm::uvec2(n)));
+		}
+		if (e)
+			m_aa_pixels[aa_count++] = coord;
+	});
+
+	// trace only the listed pixels again
+	auto count = aa_count.load();
+	auto chunk_size = 64u;
+	m_pool.parallel((count + chunk_size - 1) / chunk_size, [&] (unsigned chunk) {
+		auto end = std::min(count, (chunk + 1) * chunk_size);
+		for (auto i = chunk * chunk_size; i < end; ++i) {
+			auto coord = m_aa_pixels[i];
+			auto c = tile_rays(coord).refine(glm::vec2(coord), glm::vec2(output_size), xyz(pixel(coord)));
+			pixel(coord) = glm::vec4(c, 1);
+		}
+	});
+
+	return count;
+}
+
+void CpuRenderer::prune(const Rays& rays, glm::uvec2 output_size, unsigned tile_size, std::vector<std::uint32_t>& masks)
+{
+	static_assert(Rays::march_segments == 8);
+
+	auto tiles = (output_size + tile_size - 1u) / tile_size;
+	auto offset = masks.size();
+	masks.resize(offset + tiles.x * tiles.y * 2);
+	m_pool.parallel(tiles.x * tiles.y, [&] (unsigned tile) {
+		auto begin = glm::uvec2(tile % tiles.x, tile / tiles.x) * tile_size;
+		auto end = glm::min(begin + tile_size, output_size);
+		auto tile_rays = rays;
+		tile_rays.prune_tile(glm::vec2(begin), glm::vec2(end - 1u), glm::vec2(output_size));
+
+		auto packed = masks.data() + offset + tile * 2;
+		packed[0] = packed[1] = 0;
+		for (auto s = 0; s < Rays::march_segments; ++s)
+			packed[s / 4] |= (tile_rays.march_masks[s] & 0xff) << (s % 4 * 8);
+	});
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "parallel.hpp"
+#include "rays.hpp"
+
+/*
+ * marches a view on the cpu, using the same code path as the compute shader.
+ * the image is split into tiles which the threads of a pool pick up until none are left.
+ * all threads share the const march context, so it must not change while rendering.
+ * with antialiasing, the pixels on edges in the gbuffer of the first pass are
+ * collected into a list and only those are traced again with more rays.
+ * with tile pruning, every tile marches a scene reduced to the terms that can be visible in it
+ */
+class CpuRenderer {
+public:
+	explicit CpuRenderer(unsigned thread_count = 0);
+
+	// fill output_size pixels of image (row major, image_width wide) at rays.render_translation.
+	// returns the number of pixels refined by antialiasing
+	unsigned render(const Rays& rays, glm::uvec2 output_size, std::vector<glm::vec4>& image, unsigned image_width);
+
+	// append the march masks of every tile (row major, tile_size pixels wide),
+	// packed one byte per march segment, for the compute shader
+	void prune(const Rays& rays, glm::uvec2 output_size, unsigned tile_size, std::vector<std::uint32_t>& masks);
+
+	static constexpr unsigned tile_size = 16;
+	// tiles of prune() for the compute shader, coarse so pruning stays cheap next to a frame
+	static constexpr unsigned gpu_tile_size = 64;
+
+	bool m_antialiasing = true;
+	bool m_tile_pruning = true;
+
+private:
+	ThreadPool m_pool;
+	std::vector<glm::vec4> m_gbuffer;
+	std::vector<glm::uvec2> m_aa_pixels;
+	std::vector<Rays> m_tile_rays;
+};
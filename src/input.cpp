@@ -0,0 +1,39 @@
+#include "input.hpp"
+#include <iostream>
+
+std::set<int> Input::jids;
+void Input::jid_callback(int jid, int event)
+{
+	if (event == GLFW_CONNECTED) {
+		jids.insert(jid);
+		std::cout << "joystick connected" << std::endl;
+	}
+	else if (event == GLFW_DISCONNECTED) {
+		jids.erase(jid);
+		std::cout << "joystick disconnected" << std::endl;
+	}
+
+	std::cout << "with name: " << glfwGetJoystickName(jid) << std::endl;
+	if (glfwJoystickIsGamepad(jid)) {
+		std::cout << "is a gamepad with name: " << glfwGetGamepadName(jid) << std::endl;
+	}
+}
+
+void Input::poll(GLFWwindow* window, InputSnapshot& snapshot)
+{
+	for (int key = GLFW_KEY_SPACE; key <= GLFW_KEY_LAST; ++key)
+		snapshot.keys[key] = glfwGetKey(window, key) == GLFW_PRESS;
+	for (int button = 0; button <= GLFW_MOUSE_BUTTON_LAST; ++button)
+		snapshot.mouse_buttons[button] = glfwGetMouseButton(window, button) == GLFW_PRESS;
+	glfwGetCursorPos(window, &snapshot.cursor.x, &snapshot.cursor.y);
+	glfwGetWindowSize(window, &snapshot.window_size.x, &snapshot.window_size.y);
+
+	snapshot.gamepad_count = 0;
+	for (int jid : jids) {
+		if (snapshot.gamepad_count == InputSnapshot::max_gamepads)
+			break;
+		if (glfwJoystickIsGamepad(jid)
+				&& glfwGetGamepadState(jid, &snapshot.gamepads[snapshot.gamepad_count]))
+			++snapshot.gamepad_count;
+	}
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <array>
+#include <set>
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// state of every input device, polled once per frame
+struct InputSnapshot {
+	static constexpr int max_gamepads = 4;
+
+	std::array<bool, GLFW_KEY_LAST + 1> keys = {};
+	std::array<bool, GLFW_MOUSE_BUTTON_LAST + 1> mouse_buttons = {};
+	glm::dvec2 cursor = {0, 0};
+	glm::ivec2 window_size = {1, 1};
+
+	std::array<GLFWgamepadstate, max_gamepads> gamepads = {};
+	int gamepad_count = 0;
+};
+
+class Input {
+public:
+	static void jid_callback(int jid, int event);
+
+	// must be called from the main thread
+	static void poll(GLFWwindow* window, InputSnapshot& snapshot);
+
+private:
+	static std::set<int> jids;
+};
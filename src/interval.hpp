@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+/*
+ * interval arithmetic for bounding sdf terms over a box of space.
+ * every operation returns an interval containing all possible results
+ */
+struct Interval {
+	float lo;
+	float hi;
+};
+
+struct Interval3 {
+	Interval x;
+	Interval y;
+	Interval z;
+};
+
+inline Interval operator + (Interval a, Interval b) { return {a.lo + b.lo, a.hi + b.hi}; }
+inline Interval operator - (Interval a, Interval b) { return {a.lo - b.hi, a.hi - b.lo}; }
+inline Interval operator - (Interval a) { return {-a.hi, -a.lo}; }
+inline Interval operator + (Interval a, float b) { return {a.lo + b, a.hi + b}; }
+inline Interval operator - (Interval a, float b) { return {a.lo - b, a.hi - b}; }
+
+inline Interval operator * (Interval a, float b)
+{
+	return b < 0 ? Interval{a.hi * b, a.lo * b} : Interval{a.lo * b, a.hi * b};
+}
+
+inline Interval min(Interval a, Interval b) { return {std::min(a.lo, b.lo), std::min(a.hi, b.hi)}; }
+inline Interval max(Interval a, Interval b) { return {std::max(a.lo, b.lo), std::max(a.hi, b.hi)}; }
+inline Interval max(Interval a, float b) { return {std::max(a.lo, b), std::max(a.hi, b)}; }
+
+inline Interval abs(Interval a)
+{
+	if (a.lo >= 0) return a;
+	if (a.hi <= 0) return -a;
+	return {0, std::max(-a.lo, a.hi)};
+}
+
+inline Interval square(Interval a)
+{
+	a = abs(a);
+	return {a.lo * a.lo, a.hi * a.hi};
+}
+
+inline Interval sqrt(Interval a) { return {std::sqrt(std::max(a.lo, 0.f)), std::sqrt(std::max(a.hi, 0.f))}; }
+
+inline Interval3 box(glm::vec3 lo, glm::vec3 hi) { return {{lo.x, hi.x}, {lo.y, hi.y}, {lo.z, hi.z}}; }
+inline Interval3 operator - (Interval3 a, glm::vec3 b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+inline Interval3 abs(Interval3 a) { return {abs(a.x), abs(a.y), abs(a.z)}; }
+inline Interval3 max(Interval3 a, float b) { return {max(a.x, b), max(a.y, b), max(a.z, b)}; }
+inline Interval3 operator - (Interval3 a, float b) { return {a.x - b, a.y - b, a.z - b}; }
+
+inline Interval dot(Interval3 a, glm::vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Interval length(Interval3 a) { return sqrt(square(a.x) + square(a.y) + square(a.z)); }
+
+inline Interval3 operator * (const glm::mat3& m, Interval3 v)
+{
+	auto row = [&] (int i) { return v.x * m[0][i] + v.y * m[1][i] + v.z * m[2][i]; };
+	return {row(0), row(1), row(2)};
+}
@@ -0,0 +1,375 @@
+#include "level.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <tuple>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "rays.hpp"
+
+using namespace glm;
+
+static bool less(ivec3 a, ivec3 b)
+{
+	return std::tie(a.z, a.y, a.x) < std::tie(b.z, b.y, b.x);
+}
+
+static std::size_t pageAlign(std::size_t size)
+{
+	return (size + Level::page_size - 1) / Level::page_size * Level::page_size;
+}
+
+Level::Level(const std::string& filepath)
+{
+	int fd = open(filepath.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::cout << "Unable to open file '" << filepath << "'" << std::endl;
+		return;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof (Header)) {
+		auto data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			m_data = static_cast<const std::uint8_t*>(data);
+			m_size = st.st_size;
+		}
+	}
+	close(fd);
+
+	if (m_data && !valid()) {
+		munmap(const_cast<std::uint8_t*>(m_data), m_size);
+		m_data = nullptr;
+	}
+	if (!m_data)
+	{
+		std::cout << "Invalid level file '" << filepath << "'" << std::endl;
+		return;
+	}
+
+	// chunks are read in no particular order, readahead would only page in distant ones
+	madvise(const_cast<std::uint8_t*>(m_data), m_size, MADV_RANDOM);
+}
+
+// every chunk has to lie after the index and inside of the file. only the index is read
+bool Level::valid() const
+{
+	if (std::memcmp(header().magic, "MSLV", 4) != 0 || header().version != version)
+		return false;
+
+	auto index_end = sizeof (Header) + std::uint64_t(header().chunk_count) * sizeof (ChunkEntry);
+	if (index_end > m_size)
+		return false;
+
+	for (auto i = 0ul; i < header().chunk_count; ++i) {
+		auto& e = entries()[i];
+		auto bytes = std::uint64_t(e.primitive_count) * sizeof (Primitive)
+			+ std::uint64_t(e.brick_count) * sizeof (Brick) + std::uint64_t(e.sample_count) * sizeof (float);
+		if (e.offset % page_size != 0 || e.offset < index_end || e.offset + bytes > m_size)
+			return false;
+	}
+
+	return true;
+}
+
+Level::~Level()
+{
+	if (m_data)
+		munmap(const_cast<std::uint8_t*>(m_data), m_size);
+}
+
+long Level::find(ivec3 coord) const
+{
+	auto begin = entries();
+	auto end = begin + header().chunk_count;
+	auto it = std::lower_bound(begin, end, coord, [](const ChunkEntry& e, ivec3 c) { return less(e.coord, c); });
+	return it != end && it->coord == coord ? it - begin : -1;
+}
+
+const Level::ChunkEntry& Level::entry(long index) const
+{
+	return entries()[index];
+}
+
+const Level::Primitive* Level::primitives(long index) const
+{
+	return reinterpret_cast<const Primitive*>(m_data + entry(index).offset);
+}
+
+const Level::Brick* Level::bricks(long index) const
+{
+	return reinterpret_cast<const Brick*>(primitives(index) + entry(index).primitive_count);
+}
+
+const float* Level::samples(long index) const
+{
+	return reinterpret_cast<const float*>(bricks(index) + entry(index).brick_count);
+}
+
+std::size_t Level::chunk_bytes(long index) const
+{
+	auto& e = entry(index);
+	auto bytes = e.primitive_count * sizeof (Primitive) + e.brick_count * sizeof (Brick) + e.sample_count * sizeof (float);
+	return std::min(pageAlign(bytes), m_size - e.offset);
+}
+
+void Level::prefetch(long index) const
+{
+	madvise(const_cast<std::uint8_t*>(m_data) + entry(index).offset, chunk_bytes(index), MADV_WILLNEED);
+}
+
+void Level::evict(long index) const
+{
+	madvise(const_cast<std::uint8_t*>(m_data) + entry(index).offset, chunk_bytes(index), MADV_DONTNEED);
+}
+
+unsigned LevelView::hash(ivec3 coord)
+{
+	return static_cast<unsigned>(coord.x) * 73856093u ^ static_cast<unsigned>(coord.y) * 19349663u ^ static_cast<unsigned>(coord.z) * 83492791u;
+}
+
+// the table is at most half full, so probing always ends at a free entry
+int LevelView::find(ivec3 coord) const
+{
+	auto mask = static_cast<unsigned>(table.size()) - 1;
+	for (auto i = hash(coord) & mask; ; i = (i + 1) & mask)
+		if (table[i].w < 0 || ivec3(table[i]) == coord)
+			return table[i].w;
+}
+
+// no chunks resident, with slots large enough for the largest chunk of the level
+static LevelView emptyView(const Level& level)
+{
+	auto view = LevelView();
+	view.chunk_size = level.chunk_size();
+	for (auto i = 0u; i < level.chunk_count(); ++i) {
+		auto& e = level.entry(i);
+		view.slot_primitives = std::max(view.slot_primitives, e.primitive_count);
+		view.slot_bricks = std::max(view.slot_bricks, e.brick_count);
+		view.slot_samples = std::max(view.slot_samples, e.sample_count);
+	}
+	view.table.assign(64, ivec4(-1));
+	return view;
+}
+
+Streamer::Streamer(const Level& level, int radius)
+	: m_level(level)
+	, m_radius(radius)
+	, m_resident_view(emptyView(level))
+	, m_view(std::make_shared<LevelView>(m_resident_view))
+	, m_thread([this](std::stop_token stop_token) { stream(stop_token); })
+{
+}
+
+// only wakes the streamer when a player has entered another chunk
+void Streamer::update(const std::vector<vec3>& positions)
+{
+	auto centers = std::vector<ivec3>();
+	for (auto& pos : positions)
+		centers.push_back(ivec3(floor(pos / m_level.chunk_size())));
+	{
+		auto lock = std::lock_guard(m_mutex);
+		if (centers == m_centers)
+			return;
+		m_centers = std::move(centers);
+		m_centers_changed = true;
+	}
+	m_condition.notify_one();
+}
+
+std::shared_ptr<const LevelView> Streamer::view() const
+{
+	auto lock = std::lock_guard(m_mutex);
+	return m_view;
+}
+
+void Streamer::stream(std::stop_token stop_token)
+{
+	while (!stop_token.stop_requested()) {
+		std::vector<ivec3> centers;
+		{
+			auto lock = std::unique_lock(m_mutex);
+			if (!m_condition.wait(lock, stop_token, [this] { return m_centers_changed; }))
+				return;
+			centers = m_centers;
+			m_centers_changed = false;
+		}
+
+		// the chunks around every player that exist in the file
+		std::vector<long> wanted;
+		for (auto center : centers) {
+			for (int z = -m_radius; z <= m_radius; ++z)
+				for (int y = -m_radius; y <= m_radius; ++y)
+					for (int x = -m_radius; x <= m_radius; ++x)
+						if (auto index = m_level.find(center + ivec3(x, y, z)); index >= 0)
+							wanted.push_back(index);
+		}
+		std::sort(wanted.begin(), wanted.end());
+		wanted.erase(std::unique(wanted.begin(), wanted.end()), wanted.end());
+		std::vector<long> resident;
+		for (auto& [index, slot] : m_resident)
+			resident.push_back(index);
+		if (wanted == resident)
+			continue;
+
+		// evicted chunks free their slots, entered chunks are copied into free or new ones
+		std::vector<long> changed;
+		std::set_difference(resident.begin(), resident.end(), wanted.begin(), wanted.end(), std::back_inserter(changed));
+		for (auto index : changed) {
+			m_level.evict(index);
+			auto it = std::lower_bound(m_resident.begin(), m_resident.end(), index, [](const std::pair<long, int>& r, long i) { return r.first < i; });
+			m_resident_view.slots[it->second] = nullptr;
+			m_free_slots.push_back(it->second);
+			m_resident.erase(it);
+		}
+		changed.clear();
+		std::set_difference(wanted.begin(), wanted.end(), resident.begin(), resident.end(), std::back_inserter(changed));
+		for (auto index : changed)
+			m_level.prefetch(index);
+		for (auto index : changed) {
+			auto slot = static_cast<int>(m_resident_view.slots.size());
+			if (m_free_slots.empty()) {
+				m_resident_view.slots.emplace_back();
+			} else {
+				slot = m_free_slots.back();
+				m_free_slots.pop_back();
+			}
+			m_resident_view.slots[slot] = load(index);
+			m_resident.emplace_back(index, slot);
+		}
+		std::sort(m_resident.begin(), m_resident.end());
+
+		auto capacity = 64u;
+		while (capacity < 2 * m_resident.size())
+			capacity *= 2;
+		auto& table = m_resident_view.table;
+		table.assign(capacity, ivec4(-1));
+		for (auto [index, slot] : m_resident) {
+			auto coord = m_level.entry(index).coord;
+			auto i = LevelView::hash(coord) & (capacity - 1);
+			while (table[i].w >= 0)
+				i = (i + 1) & (capacity - 1);
+			table[i] = ivec4(coord, slot);
+		}
+
+		// copies only the table and the slot pointers, the chunks are shared
+		auto view = std::make_shared<LevelView>(m_resident_view);
+		auto lock = std::lock_guard(m_mutex);
+		m_view = std::move(view);
+	}
+}
+
+std::shared_ptr<const LevelView::Chunk> Streamer::load(long index) const
+{
+	auto& e = m_level.entry(index);
+	auto chunk = std::make_shared<LevelView::Chunk>();
+	auto primitives = m_level.primitives(index);
+	chunk->primitives.assign(primitives, primitives + e.primitive_count);
+	auto bricks = m_level.bricks(index);
+	for (auto i = 0u; i < e.brick_count; ++i) {
+		// skip bricks whose samples lie outside of their chunk
+		auto n = std::uint64_t(bricks[i].samples.y);
+		if (n < 2 || bricks[i].samples.x + n * n * n > e.sample_count)
+			continue;
+		chunk->bricks.push_back(bricks[i]);
+	}
+	auto samples = m_level.samples(index);
+	chunk->samples.assign(samples, samples + e.sample_count);
+	return chunk;
+}
+
+/*
+ * every chunk gets a floor tile below it, a few rounded pillars and spheres, and every
+ * third chunk a torus baked into a brick. everything stays inside its chunk
+ */
+bool bakeLevel(const std::string& filepath, int size)
+{
+	std::ofstream fstream(filepath, std::ios::binary);
+	if (!fstream.is_open())
+	{
+		std::cout << "Unable to open file '" << filepath << "'" << std::endl;
+		return false;
+	}
+
+	const float chunk_size = 8;
+	const unsigned brick_resolution = 16;
+	auto rays = Rays();
+
+	struct Chunk {
+		std::vector<Level::Primitive> primitives;
+		std::vector<Level::Brick> bricks;
+		std::vector<float> samples;
+	};
+
+	auto header = Level::Header{{'M', 'S', 'L', 'V'}, Level::version, chunk_size, static_cast<std::uint32_t>(2 * size * size)};
+	auto entries = std::vector<Level::ChunkEntry>();
+	auto chunks = std::vector<Chunk>();
+	auto offset = pageAlign(sizeof (header) + header.chunk_count * sizeof (Level::ChunkEntry));
+
+	// z major, as the index is sorted by (z, y, x). the floor tiles get their own layer below
+	for (int z = -size / 2; z < size - size / 2; ++z) {
+		for (int y = -1; y <= 0; ++y) {
+			for (int x = -size / 2; x < size - size / 2; ++x) {
+				auto rng = std::mt19937(static_cast<unsigned>(x) * 73856093u ^ static_cast<unsigned>(z) * 19349663u);
+				auto random = [&](float lo, float hi) { return std::uniform_real_distribution<float>(lo, hi)(rng); };
+				auto base = vec3(x, y, z) * chunk_size;
+				auto& chunk = chunks.emplace_back();
+
+				if (y < 0) {
+					chunk.primitives.push_back({vec4(base + vec3(4, 7.5, 4), 0), vec4(4, .5, 4, 0)});
+				} else {
+					for (int i = int(random(1, 4)); i > 0; --i) {
+						auto h = random(.5, 2);
+						chunk.primitives.push_back({vec4(base + vec3(random(1, 7), h, random(1, 7)), 0), vec4(random(.3, .8), h, random(.3, .8), .05)});
+					}
+					if (random(0, 1) < .5) {
+						auto r = random(.3, .8);
+						chunk.primitives.push_back({vec4(base + vec3(random(1, 7), r + random(0, 1), random(1, 7)), 1), vec4(0, 0, 0, r)});
+					}
+				}
+
+				if (y == 0 && (x + z) % 3 == 0) {
+					auto lo = base + vec3(2, 0, 2);
+					auto m = inverse(Rays::look_at(normalize(vec3(random(-1, 1), 1, random(-1, 1)))));
+					chunk.bricks.push_back({vec4(lo, 4), uvec4(0, brick_resolution, 0, 0)});
+					for (auto k = 0u; k < brick_resolution; ++k)
+						for (auto j = 0u; j < brick_resolution; ++j)
+							for (auto i = 0u; i < brick_resolution; ++i) {
+								auto p = lo + vec3(i, j, k) * (4.f / (brick_resolution - 1));
+								chunk.samples.push_back(rays.torus(m * (p - lo - 2.f), vec2(1.2, .3)));
+							}
+				}
+
+				entries.push_back({ivec3(x, y, z), static_cast<std::uint32_t>(offset),
+					static_cast<std::uint32_t>(chunk.primitives.size()), static_cast<std::uint32_t>(chunk.bricks.size()),
+					static_cast<std::uint32_t>(chunk.samples.size()), 0});
+				offset = pageAlign(offset + chunk.primitives.size() * sizeof (Level::Primitive)
+					+ chunk.bricks.size() * sizeof (Level::Brick) + chunk.samples.size() * sizeof (float));
+			}
+		}
+	}
+
+	auto pad = [&] {
+		auto position = static_cast<std::size_t>(fstream.tellp());
+		auto zeros = std::vector<char>(pageAlign(position) - position);
+		fstream.write(zeros.data(), zeros.size());
+	};
+	fstream.write(reinterpret_cast<const char*>(&header), sizeof (header));
+	fstream.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof (Level::ChunkEntry));
+	pad();
+	for (auto& chunk : chunks) {
+		fstream.write(reinterpret_cast<const char*>(chunk.primitives.data()), chunk.primitives.size() * sizeof (Level::Primitive));
+		fstream.write(reinterpret_cast<const char*>(chunk.bricks.data()), chunk.bricks.size() * sizeof (Level::Brick));
+		fstream.write(reinterpret_cast<const char*>(chunk.samples.data()), chunk.samples.size() * sizeof (float));
+		pad();
+	}
+
+	std::cout << "baked " << entries.size() << " chunks, " << offset / 1024 << " KiB" << std::endl;
+	return true;
+}
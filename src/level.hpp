@@ -0,0 +1,144 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+
+/*
+ * binary level file, memory mapped. the world is divided into cubic chunks, every chunk
+ * holds sdf primitives and baked distance bricks that lie completely inside of it.
+ *
+ *   Header
+ *   ChunkEntry[chunk_count]  sorted by chunk coordinate (z, y, x)
+ *   chunk payloads           page aligned: Primitive[], Brick[], float samples[]
+ *
+ * opening a level only maps the file, chunks are paged in when they are read
+ */
+class Level {
+public:
+	// pos.w: 0 rounded box with half size size.xyz and rounding size.w, 1 sphere with radius size.w
+	struct Primitive {
+		glm::vec4 pos;
+		glm::vec4 size;
+	};
+
+	// cube of resolution^3 distance samples. samples: offset, resolution
+	struct Brick {
+		glm::vec4 lo_size;
+		glm::uvec4 samples;
+	};
+
+	struct Header {
+		char magic[4];
+		std::uint32_t version;
+		float chunk_size;
+		std::uint32_t chunk_count;
+	};
+
+	struct ChunkEntry {
+		glm::ivec3 coord;
+		std::uint32_t offset;
+		std::uint32_t primitive_count;
+		std::uint32_t brick_count;
+		std::uint32_t sample_count;
+		std::uint32_t padding;
+	};
+
+	static constexpr std::uint32_t version = 1;
+	static constexpr std::size_t page_size = 4096;
+
+	explicit Level(const std::string& filepath);
+	Level(const Level&) = delete;
+	Level& operator= (const Level&) = delete;
+	~Level();
+
+	bool is_open() const { return m_data != nullptr; }
+	float chunk_size() const { return header().chunk_size; }
+	std::uint32_t chunk_count() const { return header().chunk_count; }
+
+	// index of the chunk at coord, or -1
+	long find(glm::ivec3 coord) const;
+
+	const ChunkEntry& entry(long index) const;
+	const Primitive* primitives(long index) const;
+	const Brick* bricks(long index) const;
+	const float* samples(long index) const;
+
+	// hint the kernel to read a chunk ahead, or to drop its pages
+	void prefetch(long index) const;
+	void evict(long index) const;
+
+private:
+	bool valid() const;
+	const Header& header() const { return *reinterpret_cast<const Header*>(m_data); }
+	const ChunkEntry* entries() const { return reinterpret_cast<const ChunkEntry*>(m_data + sizeof (Header)); }
+	std::size_t chunk_bytes(long index) const;
+
+	const std::uint8_t* m_data = nullptr;
+	std::size_t m_size = 0;
+};
+
+// the resident part of a level, copied out of the mapping. immutable once published.
+// every resident chunk sits in a slot that holds at most slot_primitives, slot_bricks and
+// slot_samples. a chunk keeps its slot while it stays resident and its data is shared
+// between views, so only the chunks that changed need to be copied again.
+// table maps chunk coordinates to slots, open addressed with linear probing from
+// hash(coord): every entry is coord.xyz and the slot in w, -1 where it is free
+struct LevelView {
+	struct Chunk {
+		std::vector<Level::Primitive> primitives;
+		std::vector<Level::Brick> bricks; // samples.x counts from the first sample of the chunk
+		std::vector<float> samples;
+	};
+
+	float chunk_size = 0;
+	unsigned slot_primitives = 0;
+	unsigned slot_bricks = 0;
+	unsigned slot_samples = 0;
+	std::vector<glm::ivec4> table;
+	std::vector<std::shared_ptr<const Chunk>> slots;
+
+	static unsigned hash(glm::ivec3 coord);
+	// slot of the resident chunk at coord, or -1
+	int find(glm::ivec3 coord) const;
+};
+
+/*
+ * keeps the chunks within radius chunks of every player resident on a background thread.
+ * chunks that fall out of range are evicted and their slots reused, a new LevelView is
+ * published whenever the resident set changes. only entered chunks are read from the file
+ */
+class Streamer {
+public:
+	Streamer(const Level& level, int radius);
+
+	void update(const std::vector<glm::vec3>& positions);
+	std::shared_ptr<const LevelView> view() const;
+
+private:
+	void stream(std::stop_token stop_token);
+	std::shared_ptr<const LevelView::Chunk> load(long index) const;
+
+	const Level& m_level;
+	int m_radius;
+	LevelView m_resident_view;
+	std::vector<std::pair<long, int>> m_resident; // level index and slot, sorted by index
+	std::vector<int> m_free_slots;
+
+	mutable std::mutex m_mutex;
+	std::condition_variable_any m_condition;
+	std::vector<glm::ivec3> m_centers;
+	bool m_centers_changed = false;
+	std::shared_ptr<const LevelView> m_view;
+
+	std::jthread m_thread;
+};
+
+// write a procedural level of size x size chunks, to test streaming
+bool bakeLevel(const std::string& filepath, int size);
@@ -1,25 +1,183 @@
 #include <iostream>
 #include <numeric>
 #include <algorithm>
+#include <charconv>
 #include <ctime>
 #include <glm/glm.hpp>
 #include <glm/gtx/rotate_vector.hpp>
 #include <chrono>
 #include <vector>
 #include <cmath>
+#include <memory>
+#include <thread>
+#include <string>
+#include <string_view>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "shader.hpp"
 #include "watcher.hpp"
+#include "readback.hpp"
 #include "player.hpp"
+#include "simulation.hpp"
+#include "triplebuffer.hpp"
+#include "cpurenderer.hpp"
+#include "mesher.hpp"
+#include "level.hpp"
+#include "server.hpp"
 #include "misc.hpp"
 
 using namespace std::chrono_literals;
 
-int main()
+// the whole of arg as a number, false if it is not one
+template <typename T>
+static bool parseNumber(std::string_view arg, T& value)
+{
+	auto end = arg.data() + arg.size();
+	auto [ptr, ec] = std::from_chars(arg.data(), end, value);
+	return ec == std::errc() && ptr == end;
+}
+
+// polygonize the scene without a window. --mesh <file.obj|file.ply> [depth] or --mesh-bench [depth]
+static int runMesher(const std::vector<std::string_view>& args, std::vector<Player> players)
+{
+	auto bench = args[0] == "--mesh-bench";
+	auto depth_arg = bench ? 1ul : 2ul;
+	auto depth = 7u;
+	// the bench also runs dense(), which holds (2^depth + 1)^3 floats, 550 MB at depth 9
+	auto max_depth = bench ? 9u : 12u;
+	if ((!bench && args.size() < 2)
+		|| (args.size() > depth_arg && (!parseNumber(args[depth_arg], depth) || depth < 1 || depth > max_depth))) {
+		std::cout << "usage: --mesh <file.obj|file.ply> [depth], depth 1 to 12, or --mesh-bench [depth], depth 1 to 9" << std::endl;
+		return 1;
+	}
+	auto filepath = bench ? std::string() : std::string(args[1]);
+
+	auto snapshot = Rays::Snapshot();
+	Simulation(std::move(players)).snapshot(snapshot);
+	auto rays = Rays();
+	rays.snapshot = &snapshot;
+	rays.camera_player = -1;
+	auto mesher = Mesher(rays, glm::vec3(-6, -1.5, -6), glm::vec3(6, 1.5, 6), depth);
+
+	using clock = std::chrono::steady_clock;
+	auto run = [&] (const char* name, auto f) {
+		auto start = clock::now();
+		auto mesh = (mesher.*f)();
+		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - start);
+		std::cout << name << ": " << duration.count() << " ms, " << mesher.m_evaluations << " evaluations, "
+			<< mesh.positions.size() << " vertices, " << mesh.triangles.size() << " triangles" << std::endl;
+		return mesh;
+	};
+
+	auto mesh = run("sparse", &Mesher::sparse);
+	if (bench) {
+		run("dense", &Mesher::dense);
+		return 0;
+	}
+
+	auto ply = filepath.size() >= 4 && filepath.substr(filepath.size() - 4) == ".ply";
+	return (ply ? writePly(filepath, mesh) : writeObj(filepath, mesh)) ? 0 : 1;
+}
+
+// simulate matches without a window. --server <matches> [ticks] [threads] [--replay <file>] [--record <file>]
+// every player is a bot unless the replayed recording has inputs for it. --record saves the inputs of the first match
+static int runServer(const std::vector<std::string_view>& args, const std::vector<Player>& players)
+{
+	// the numbers come first, up to the first --flag
+	auto flags = std::find_if(args.begin() + 1, args.end(), [] (std::string_view arg) { return arg.starts_with("--"); });
+	auto values = std::vector<std::string_view>(args.begin() + 1, flags);
+	auto match_count = 0ul;
+	auto ticks = 3600ul;
+	auto thread_count = 0u;
+	auto replay = std::find(flags, args.end(), "--replay");
+	auto record = std::find(flags, args.end(), "--record");
+	if (values.empty() || values.size() > 3
+		|| !parseNumber(values[0], match_count) || match_count == 0
+		|| (values.size() > 1 && !parseNumber(values[1], ticks))
+		|| (values.size() > 2 && !parseNumber(values[2], thread_count))
+		|| (replay != args.end() && replay + 1 == args.end())
+		|| (record != args.end() && record + 1 == args.end())) {
+		std::cout << "usage: --server <matches> [ticks] [threads] [--replay <file>] [--record <file>]" << std::endl;
+		return 1;
+	}
+
+	auto recording = std::make_shared<PlayerInput::Recording>();
+	if (replay != args.end() && !readRecording(std::string(replay[1]), *recording))
+		return 1;
+
+	auto matches = std::vector<Server::Match>();
+	for (auto i = 0ul; i < match_count; ++i) {
+		auto& match = matches.emplace_back(Server::Match{Simulation(players), {}});
+		for (auto j = 0ul; j < players.size(); ++j)
+			match.inputs.push_back(!recording->empty() && j < recording->front().size() ?
+				PlayerInput::createReplayInput(recording, j) :
+				PlayerInput::createBotInput(static_cast<unsigned>(i * players.size() + j)));
+	}
+
+	auto first_match_inputs = PlayerInput::Recording();
+	if (record != args.end())
+		matches[0].recording = &first_match_inputs;
+
+	auto server = Server(thread_count);
+	auto report = server.run(matches, ticks);
+	auto seconds = std::chrono::duration<double>(report.duration).count();
+	auto simulated = std::chrono::duration<double>(Simulation::tick_duration * ticks).count();
+	std::cout << match_count << " matches, " << ticks << " ticks each on " << report.thread_count << " threads: "
+		<< seconds * 1000 << " ms, " << report.ticks / seconds << " ticks/s, "
+		<< report.ticks / seconds / report.thread_count << " ticks/s per core, "
+		<< simulated * match_count / seconds << "x real time, checksum " << std::hex << report.checksum << std::dec << std::endl;
+
+	if (record != args.end()) {
+		if (!writeRecording(std::string(record[1]), first_match_inputs))
+			return 1;
+		std::cout << "saved '" << record[1] << "', " << first_match_inputs.size() << " ticks" << std::endl;
+	}
+	return 0;
+}
+
+int main(int argc, char** argv)
 {
 	std::srand(std::time(0));
 
+	auto players = std::vector<Player>();
+	auto inputs = std::vector<PlayerInput>();
+	auto player_index = 0ul;
+	std::generate_n(std::back_inserter(players), 1, [&] () {
+		auto player = Player{
+			.m_pos = {0, 0, (player_index - .5f) * 4.f},
+			.m_dir = glm::normalize(glm::vec3{0, 0, -glm::sign(player_index - .5)}),
+			.m_vel = {0, 0, 0},
+		};
+		inputs.push_back(player_index == 1 ?
+			PlayerInput::createKeyboardInput() :
+			PlayerInput::createGamepadInput(0));
+		++player_index;
+		return player;
+	});
+
+	auto args = std::vector<std::string_view>(argv + 1, argv + argc);
+	if (!args.empty() && (args[0] == "--mesh" || args[0] == "--mesh-bench"))
+		return runMesher(args, std::move(players));
+	if (!args.empty() && args[0] == "--server")
+		return runServer(args, players);
+	if (!args.empty() && args[0] == "--bake-level") {
+		auto size = 64;
+		if (args.size() < 2 || (args.size() > 2 && (!parseNumber(args[2], size) || size < 1 || size > 256))) {
+			std::cout << "usage: --bake-level <file> [size], size 1 to 256 chunks" << std::endl;
+			return 1;
+		}
+		return bakeLevel(std::string(args[1]), size) ? 0 : 1;
+	}
+
+	// --level <file> streams the chunks within march distance of the players, instead of the arena
+	auto level = std::unique_ptr<Level>();
+	auto streamer = std::unique_ptr<Streamer>();
+	if (auto it = std::find(args.begin(), args.end(), "--level"); it != args.end() && it + 1 != args.end()) {
+		level = std::make_unique<Level>(std::string(it[1]));
+		if (!level->is_open()) return 1;
+		streamer = std::make_unique<Streamer>(*level, static_cast<int>(std::ceil(Rays::march_distance / level->chunk_size())));
+	}
+
 	if (!glfwInit()) return 0;
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
@@ -27,15 +185,30 @@ int main()
 	auto window = glfwCreateWindow(window_size.x, window_size.y, "glsl", nullptr, nullptr);
 
 	// keyboard
-	glfwSetKeyCallback(window, [] (GLFWwindow* window, int key, [[maybe_unused]] int scancode, [[maybe_unused]] int action, int mods) {
+	static auto screenshot_requested = false;
+	static auto recording = false;
+	static auto cpu_rendering = false;
+	static auto antialiasing = true;
+	// pruning pays off on the cpu, on the gpu it costs about what it saves, so it starts off there
+	static auto cpu_tile_pruning = true;
+	static auto gpu_tile_pruning = false;
+	glfwSetKeyCallback(window, [] (GLFWwindow* window, int key, [[maybe_unused]] int scancode, int action, int mods) {
 		if (!mods && key == GLFW_KEY_Q) glfwSetWindowShouldClose(window, true);
+		if (!mods && key == GLFW_KEY_P && action == GLFW_PRESS) screenshot_requested = true;
+		if (!mods && key == GLFW_KEY_R && action == GLFW_PRESS) recording = !recording;
+		if (!mods && key == GLFW_KEY_C && action == GLFW_PRESS) cpu_rendering = !cpu_rendering;
+		if (!mods && key == GLFW_KEY_M && action == GLFW_PRESS) antialiasing = !antialiasing;
+		if (!mods && key == GLFW_KEY_T && action == GLFW_PRESS) {
+			auto& tile_pruning = cpu_rendering ? cpu_tile_pruning : gpu_tile_pruning;
+			tile_pruning = !tile_pruning;
+		}
 	});
 
 	// joysticks
-	glfwSetJoystickCallback(PlayerInput::jid_callback);
+	glfwSetJoystickCallback(Input::jid_callback);
 	for (auto i = GLFW_JOYSTICK_1; i < GLFW_JOYSTICK_LAST; ++i)
 		if (glfwJoystickPresent(i))
-			PlayerInput::jid_callback(i, GLFW_CONNECTED);
+			Input::jid_callback(i, GLFW_CONNECTED);
 
 	glfwMakeContextCurrent(window);
 	glfwSwapInterval(0);
@@ -63,7 +236,41 @@ int main()
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, frame_tex_size.x, frame_tex_size.y, 0, GL_RGBA, GL_FLOAT, nullptr);
-	glBindImageTexture(0, frame_tex_out, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	glBindImageTexture(0, frame_tex_out, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+
+	// normal and hit distance of the first pass, to find the pixels worth antialiasing
+	GLuint frame_tex_gbuffer;
+	glGenTextures(1, &frame_tex_gbuffer);
+	glBindTexture(GL_TEXTURE_2D, frame_tex_gbuffer);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+	// indirect dispatch arguments, count of the current view, count of the frame and the pixel list
+	GLuint aa_list;
+	glCreateBuffers(1, &aa_list);
+	auto aa_list_capacity = 0u;
+	constexpr auto aa_list_header_size = 5 * sizeof (GLuint);
+	auto aa_refined = 0u;
+
+	// scene terms per coarse tile and march segment, pruned on the cpu
+	GLuint tile_mask_buffer;
+	glCreateBuffers(1, &tile_mask_buffer);
+	auto tile_masks = std::vector<std::uint32_t>();
+
+	// slots of the resident level (chunk, primitives, bricks and samples) and its table. when the
+	// streamer publishes, only the slots whose chunk changed are uploaded, the table is replaced
+	GLuint level_buffers[5];
+	glCreateBuffers(5, level_buffers);
+	auto level_slot_capacity = 0ul;
+	auto uploaded_level = std::shared_ptr<const LevelView>();
+
+	// frames are read back asynchronously and written a few frames later on a writer thread.
+	// it is destroyed before the context, which writes the frames still in flight
+	auto readback = std::make_unique<Readback>(4, 8, [] (const std::uint8_t* pixels, glm::uvec2 size, unsigned long frame, const std::string& name) {
+		auto filepath = name + "_" + std::to_string(frame) + ".ppm";
+		if (writePpm(filepath, pixels, size))
+			std::cout << "saved '" << filepath << "'" << std::endl;
+	});
 
 	glUseProgram(display_program);
 	enum { vertex_position, vertex_uv };
@@ -85,27 +292,49 @@ int main()
 	glBindVertexArray(0);
 	glUseProgram(0);
 
-	auto players = std::vector<Player>();
-	auto player_index = 0ul;
-	std::generate_n(std::back_inserter(players), 1, [&] () {
-		auto player = Player{
-			.m_pos = {0, 0, (player_index - .5f) * 4.f},
-			.m_dir = glm::normalize(glm::vec3{0, 0, -glm::sign(player_index - .5)}),
-			.m_vel = {0, 0, 0},
-			.m_input = player_index == 1 ?
-				PlayerInput::createKeyboardInput(window) :
-				PlayerInput::createGamepadInput(0)
-		};
-		++player_index;
-		return player;
+	auto player_count = players.size();
+
+	// the simulation runs on its own thread at a fixed tick rate. input samples are
+	// handed over to it and world snapshots come back, both through triple buffers
+	auto input_buffer = TripleBuffer<std::vector<PlayerInput::Sample>>(std::vector<PlayerInput::Sample>(player_count));
+	auto snapshot_buffer = TripleBuffer<Rays::Snapshot>();
+	auto simulation = Simulation(std::move(players));
+	simulation.m_streamer = streamer.get();
+	simulation.snapshot(snapshot_buffer.back());
+	snapshot_buffer.publish();
+
+	// --record-inputs <file> saves the samples of every tick, to replay them with --server
+	auto recording_path = std::string();
+	if (auto it = std::find(args.begin(), args.end(), "--record-inputs"); it != args.end() && it + 1 != args.end())
+		recording_path = it[1];
+	auto input_recording = PlayerInput::Recording();
+
+	auto simulation_thread = std::jthread([&] (std::stop_token stop_token) {
+		auto next_tick = std::chrono::steady_clock::now();
+		while (!stop_token.stop_requested()) {
+			input_buffer.update();
+			simulation.step(input_buffer.front());
+			if (!recording_path.empty())
+				input_recording.push_back(input_buffer.front());
+			simulation.snapshot(snapshot_buffer.back());
+			snapshot_buffer.publish();
+
+			next_tick += Simulation::tick_duration;
+			std::this_thread::sleep_until(next_tick);
+		}
 	});
 
+	auto cpu_renderer = CpuRenderer();
+	auto cpu_image = std::vector<glm::vec4>();
+	auto input = InputSnapshot();
+
 	using clock = std::chrono::steady_clock;
 	auto start_time = clock::now();
 	auto elapsed_time = 0ms;
 	auto fps_print_time = elapsed_time;
 
 	auto frames = 0ul;
+	auto frame_index = 0ul;
 	while (!glfwWindowShouldClose(window)) {
 		auto cur_time = clock::now();
 		auto delta_time = std::chrono::duration_cast<std::chrono::milliseconds>(cur_time - (start_time + elapsed_time));
@@ -114,26 +343,45 @@ int main()
 		compute_shader_watcher.update();
 
 		glfwPollEvents();
-		glfwGetWindowSize(window, &window_size.x, &window_size.y);
+		Input::poll(window, input);
+		window_size = input.window_size;
 		glViewport(0, 0, window_size.x, window_size.y);
 		frame_tex_size = glm::uvec2(window_size);
 		glBindTexture(GL_TEXTURE_2D, frame_tex_out);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, frame_tex_size.x, frame_tex_size.y, 0, GL_RGBA, GL_FLOAT, nullptr);
-		glBindImageTexture(0, frame_tex_out, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+		glBindImageTexture(0, frame_tex_out, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+		glBindTexture(GL_TEXTURE_2D, frame_tex_gbuffer);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, frame_tex_size.x, frame_tex_size.y, 0, GL_RGBA, GL_FLOAT, nullptr);
+		glBindImageTexture(1, frame_tex_gbuffer, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+		if (auto pixels = frame_tex_size.x * frame_tex_size.y; aa_list_capacity < pixels) {
+			aa_list_capacity = pixels;
+			glNamedBufferData(aa_list, aa_list_header_size + aa_list_capacity * sizeof (GLuint), nullptr, GL_DYNAMIC_DRAW);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, aa_list);
+		}
 
-		glm::dvec2 mouse;
-		glfwGetCursorPos(window, &mouse.x, &mouse.y);
+		auto mouse = input.cursor;
 		auto m = -glm::pi<float>() * glm::vec2(mouse - glm::dvec2(window_size) * .5) / static_cast<float>(window_size.y);
 
 		auto camera_pos = glm::vec3(0, 2, 0)
 			+ glm::vec3(glm::sin(m.x) * glm::cos(m.y), glm::sin(m.y), glm::cos(m.x) * glm::cos(m.y)) * 5.f;
 		auto camera_dir = glm::normalize(-camera_pos);
 
+		{ // map the polled devices to player input and hand it to the simulation
+			auto& samples = input_buffer.back();
+			samples.resize(inputs.size());
+			for (auto i = 0ul; i < inputs.size(); ++i)
+				samples[i] = inputs[i].sample(input);
+			input_buffer.publish();
+		}
+
+		snapshot_buffer.update();
+		auto& snapshot = snapshot_buffer.front();
+
 		{ // launch compute shaders and draw to image
 			glMemoryBarrier(GL_ALL_BARRIER_BITS);
 			glUseProgram(compute_program);
 
-			glm::ivec2 render_screens_count = glm::ivec2(players.size() % 2, players.size() / 2 + 1);
+			glm::ivec2 render_screens_count = glm::ivec2(player_count % 2, player_count / 2 + 1);
 			glm::ivec2 render_size = glm::ceil(glm::vec2(window_size) / glm::vec2(render_screens_count));
 			glUniform2i(glGetUniformLocation(compute_program, "render_size"), render_size.x, render_size.y);
 
@@ -141,37 +389,152 @@ int main()
 			glUniform1f(glGetUniformLocation(compute_program, "delta_time"), delta_time.count() / 1000.f);
 			glUniform2i(glGetUniformLocation(compute_program, "mouse_coord"), mouse.x, window_size.y - mouse.y);
 
-			for (auto i = 0ul; i < players.size(); ++i) {
-				players[i].update(delta_time);
+			for (auto i = 0ul; i < std::size(snapshot.players); ++i) {
+				auto& player = snapshot.players[i];
 				auto player_str = std::string("players[") + std::to_string(i) + "]";
 				glUniform4f(glGetUniformLocation(compute_program, (player_str + ".pos").c_str()),
-					players[i].m_pos.x, players[i].m_pos.y, players[i].m_pos.z, 1);
+					player.pos.x, player.pos.y, player.pos.z, player.pos.w);
 				glUniform4f(glGetUniformLocation(compute_program, (player_str + ".dir").c_str()),
-					players[i].m_dir.x, players[i].m_dir.y, players[i].m_dir.z, 1);
+					player.dir.x, player.dir.y, player.dir.z, player.dir.w);
 				glUniform4f(glGetUniformLocation(compute_program, (player_str + ".vel").c_str()),
-					players[i].m_vel.x, players[i].m_vel.y, players[i].m_vel.z, 1);
+					player.vel.x, player.vel.y, player.vel.z, player.vel.w);
+
+				auto& entity = snapshot.entities[i];
+				auto entity_str = std::string("entities[") + std::to_string(i) + "]";
+				glUniformMatrix3fv(glGetUniformLocation(compute_program, (entity_str + ".to_local").c_str()),
+					1, GL_FALSE, &entity.to_local[0][0]);
+				glUniform3f(glGetUniformLocation(compute_program, (entity_str + ".pos").c_str()),
+					entity.pos.x, entity.pos.y, entity.pos.z);
+				glUniform4f(glGetUniformLocation(compute_program, (entity_str + ".extents").c_str()),
+					entity.extents.x, entity.extents.y, entity.extents.z, entity.extents.w);
+				glUniform1i(glGetUniformLocation(compute_program, (entity_str + ".enabled").c_str()), entity.enabled);
 			}
 
-			for (auto i = 0ul; i < players.size(); ++i) {
+			if (cpu_rendering)
+				cpu_image.resize(frame_tex_size.x * frame_tex_size.y);
+			cpu_renderer.m_antialiasing = antialiasing;
+			cpu_renderer.m_tile_pruning = cpu_tile_pruning;
+			glUniform1i(glGetUniformLocation(compute_program, "tile_pruning"), gpu_tile_pruning && !cpu_rendering);
+			glUniform1i(glGetUniformLocation(compute_program, "prune_tile_size"), CpuRenderer::gpu_tile_size);
+
+			if (snapshot.level && snapshot.level != uploaded_level) {
+				auto& view = *snapshot.level;
+				std::size_t slot_bytes[] = {
+					sizeof (glm::uvec4), view.slot_primitives * sizeof (Level::Primitive),
+					view.slot_bricks * sizeof (Level::Brick), view.slot_samples * sizeof (float),
+				};
+				// the slot buffers grow with the largest resident set and keep the uploaded slots
+				if (level_slot_capacity < view.slots.size()) {
+					auto capacity = std::max(view.slots.size(), 2 * level_slot_capacity);
+					for (auto i = 0; i < 4; ++i) {
+						GLuint buffer;
+						glCreateBuffers(1, &buffer);
+						glNamedBufferData(buffer, capacity * slot_bytes[i], nullptr, GL_DYNAMIC_DRAW);
+						if (level_slot_capacity * slot_bytes[i] > 0)
+							glCopyNamedBufferSubData(level_buffers[i], buffer, 0, 0, level_slot_capacity * slot_bytes[i]);
+						glDeleteBuffers(1, &level_buffers[i]);
+						level_buffers[i] = buffer;
+						glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2 + i, buffer);
+					}
+					level_slot_capacity = capacity;
+				}
+				for (auto slot = 0ul; slot < view.slots.size(); ++slot) {
+					auto& chunk = view.slots[slot];
+					if (!chunk || (uploaded_level && slot < uploaded_level->slots.size() && uploaded_level->slots[slot] == chunk))
+						continue;
+					auto record = glm::uvec4(slot * view.slot_primitives, chunk->primitives.size(), slot * view.slot_bricks, chunk->bricks.size());
+					auto bricks = chunk->bricks;
+					for (auto& brick : bricks)
+						brick.samples.x += slot * view.slot_samples;
+					glNamedBufferSubData(level_buffers[0], slot * slot_bytes[0], sizeof (record), &record);
+					glNamedBufferSubData(level_buffers[1], slot * slot_bytes[1], chunk->primitives.size() * sizeof (Level::Primitive), chunk->primitives.data());
+					glNamedBufferSubData(level_buffers[2], slot * slot_bytes[2], bricks.size() * sizeof (Level::Brick), bricks.data());
+					glNamedBufferSubData(level_buffers[3], slot * slot_bytes[3], chunk->samples.size() * sizeof (float), chunk->samples.data());
+				}
+				glNamedBufferData(level_buffers[4], view.table.size() * sizeof (view.table[0]), view.table.data(), GL_DYNAMIC_DRAW);
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, level_buffers[4]);
+				// holding the view keeps its chunks alive, so a new chunk never reuses the address of an uploaded one
+				uploaded_level = snapshot.level;
+			}
+			glUniform1i(glGetUniformLocation(compute_program, "level_loaded"), snapshot.level != nullptr);
+			if (snapshot.level)
+				glUniform1f(glGetUniformLocation(compute_program, "level_chunk_size"), snapshot.level->chunk_size);
+			aa_refined = 0;
+
+			GLuint aa_list_reset[] = {0, 1, 1, 0, 0};
+			glNamedBufferSubData(aa_list, 0, sizeof (aa_list_reset), aa_list_reset);
+
+			for (auto i = 0ul; i < player_count; ++i) {
 				glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
 				glm::ivec2 render_screen = glm::ivec2(i % 2, i / 2);
 				glm::ivec2 render_translation = glm::vec2(render_screen) * glm::ceil(glm::vec2(window_size) * .5f);
-				auto camera_pos = players[i].m_pos + glm::vec3(0, .4, 0);
-				auto camera_dir = players[i].m_dir;
+				auto camera_pos = xyz(snapshot.players[i].pos) + glm::vec3(0, .4, 0);
+				auto camera_dir = xyz(snapshot.players[i].dir);
+
+				auto rays = Rays{
+					.snapshot = &snapshot,
+					.render_translation = render_translation,
+					.render_size = render_size,
+					.elapsed_time = elapsed_time.count() / 1000.f,
+					.delta_time = delta_time.count() / 1000.f,
+					.mouse_coord = glm::ivec2(mouse.x, window_size.y - mouse.y),
+					.camera_pos = camera_pos,
+					.camera_dir = camera_dir,
+					.camera_player = static_cast<int>(i),
+				};
+				auto output_size = glm::min(glm::uvec2(render_size), frame_tex_size - glm::uvec2(render_translation));
+
+				if (cpu_rendering) {
+					aa_refined += cpu_renderer.render(rays, output_size, cpu_image, frame_tex_size.x);
+					continue;
+				}
+
+				if (gpu_tile_pruning) {
+					tile_masks.clear();
+					cpu_renderer.prune(rays, output_size, CpuRenderer::gpu_tile_size, tile_masks);
+					glNamedBufferData(tile_mask_buffer, tile_masks.size() * sizeof (std::uint32_t), tile_masks.data(), GL_STREAM_DRAW);
+					glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, tile_mask_buffer);
+				}
+
 				glUniform2i(glGetUniformLocation(compute_program, "render_translation"), render_translation.x, render_translation.y);
 				glUniform3f(glGetUniformLocation(compute_program, "camera_pos"), camera_pos.x, camera_pos.y, camera_pos.z);
 				glUniform3f(glGetUniformLocation(compute_program, "camera_dir"), camera_dir.x, camera_dir.y, camera_dir.z);
 				glUniform1i(glGetUniformLocation(compute_program, "camera_player"), i);
-				glDispatchCompute(
+				auto groups = glm::uvec2(
 					min2(render_size.x, frame_tex_size.x - render_translation.x) / 8 + 1,
-					min2(render_size.y, frame_tex_size.y - render_translation.y) / 8 + 1, 1);
+					min2(render_size.y, frame_tex_size.y - render_translation.y) / 8 + 1);
+
+				glUniform1i(glGetUniformLocation(compute_program, "aa_pass"), 0);
+				glDispatchCompute(groups.x, groups.y, 1);
+
+				if (antialiasing) { // detect edges, then refine only the listed pixels
+					glNamedBufferSubData(aa_list, 0, 4 * sizeof (GLuint), aa_list_reset);
+					glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+					glUniform1i(glGetUniformLocation(compute_program, "aa_pass"), 1);
+					glDispatchCompute(groups.x, groups.y, 1);
+
+					glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+					glUniform1i(glGetUniformLocation(compute_program, "aa_pass"), 2);
+					glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, aa_list);
+					glDispatchComputeIndirect(0);
+					glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+				}
 			}
+
+			if (cpu_rendering)
+				glTextureSubImage2D(frame_tex_out, 0, 0, 0, frame_tex_size.x, frame_tex_size.y, GL_RGBA, GL_FLOAT, cpu_image.data());
 		}
 
 		// make sure writing to image has finished before read
 		glMemoryBarrier(GL_ALL_BARRIER_BITS);
-		
+
+		if (screenshot_requested || recording) {
+			readback->request(frame_tex_out, frame_tex_size, frame_index, recording ? "capture" : "screenshot");
+			screenshot_requested = false;
+		}
+		readback->update();
+
 		{ // present image to screen
 			glUseProgram(display_program);
 			glUniform2i(glGetUniformLocation(display_program, "tex_size"), frame_tex_size.x, frame_tex_size.y);
@@ -185,13 +548,28 @@ int main()
 		}
 
 		++frames;
+		++frame_index;
 		if (fps_print_time.count() + 1000 < elapsed_time.count()) {
 			fps_print_time += elapsed_time - fps_print_time;
-			std::cout << frames << " fps" << std::endl;
+			std::cout << frames << " fps";
+			if (antialiasing) {
+				if (!cpu_rendering) // a small stall once a second
+					glGetNamedBufferSubData(aa_list, 4 * sizeof (GLuint), sizeof (GLuint), &aa_refined);
+				std::cout << ", " << 100.f * aa_refined / (frame_tex_size.x * frame_tex_size.y) << "% pixels refined";
+			}
+			if (readback->dropped())
+				std::cout << ", " << readback->dropped() << " frames dropped by readback";
+			std::cout << std::endl;
 			frames = 0;
 		}
 	}
 
+	simulation_thread.request_stop();
+	simulation_thread.join();
+	if (!recording_path.empty() && writeRecording(recording_path, input_recording))
+		std::cout << "saved '" << recording_path << "', " << input_recording.size() << " ticks" << std::endl;
+
+	readback.reset();
 	glfwTerminate();
 
 	return 0;
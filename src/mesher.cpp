@@ -0,0 +1,269 @@
+#include "mesher.hpp"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+namespace {
+	// corner i of a cell has the offset (bit 0, bit 1, bit 2)
+	glm::uvec3 corner_offset(unsigned i)
+	{
+		return glm::uvec3(i & 1, i >> 1 & 1, i >> 2 & 1);
+	}
+
+	// six tetrahedra around the diagonal from corner 0 to 7. along every edge the
+	// corner bits only grow, which makes neighbouring cells split their faces alike
+	const unsigned tetrahedra[6][4] = {
+		{0, 7, 1, 3}, {0, 7, 3, 2}, {0, 7, 2, 6},
+		{0, 7, 6, 4}, {0, 7, 4, 5}, {0, 7, 5, 1},
+	};
+}
+
+Mesher::Mesher(const Rays& rays, glm::vec3 lo, glm::vec3 hi, unsigned depth, unsigned thread_count)
+	: m_rays(rays)
+	, m_lo(lo)
+	, m_resolution(1u << depth)
+	, m_pool(thread_count)
+{
+	auto extent = hi - lo;
+	m_cell_size = std::max(extent.x, std::max(extent.y, extent.z)) / m_resolution;
+}
+
+glm::vec3 Mesher::position(glm::uvec3 corner) const
+{
+	return m_lo + glm::vec3(corner) * m_cell_size;
+}
+
+std::uint64_t Mesher::corner_index(glm::uvec3 corner) const
+{
+	std::uint64_t n = m_resolution + 1;
+	return corner.x + n * (corner.y + n * corner.z);
+}
+
+void Mesher::descend(glm::uvec3 origin, unsigned size, Part& part) const
+{
+	auto extent = m_cell_size * size;
+	++part.evaluations;
+	if (std::abs(m_rays.scene(position(origin) + extent * .5f)) > extent * std::sqrt(3.f))
+		return;
+
+	// evaluate the corners of small bricks at once, so neighbouring cells share them
+	if (size <= brick_size) {
+		auto n = size + 1;
+		float values[(brick_size + 1) * (brick_size + 1) * (brick_size + 1)];
+		auto value = [&] (glm::uvec3 c) -> float& { return values[c.x + n * (c.y + n * c.z)]; };
+		for (auto z = 0u; z < n; ++z)
+			for (auto y = 0u; y < n; ++y)
+				for (auto x = 0u; x < n; ++x)
+					value(glm::uvec3(x, y, z)) = m_rays.scene(position(origin + glm::uvec3(x, y, z)));
+		part.evaluations += n * n * n;
+
+		for (auto z = 0u; z < size; ++z) {
+			for (auto y = 0u; y < size; ++y) {
+				for (auto x = 0u; x < size; ++x) {
+					float cell[8];
+					for (auto i = 0u; i < 8; ++i)
+						cell[i] = value(glm::uvec3(x, y, z) + corner_offset(i));
+					polygonize(origin + glm::uvec3(x, y, z), cell, part);
+				}
+			}
+		}
+		return;
+	}
+
+	auto half = size / 2;
+	for (auto i = 0u; i < 8; ++i)
+		descend(origin + corner_offset(i) * half, half, part);
+}
+
+void Mesher::polygonize(glm::uvec3 origin, const float corner_values[8], Part& part) const
+{
+	// distances this close to zero put the surface on the corner. a corner has the same value
+	// in every cell, so all edges through it agree and share one vertex at the corner
+	float values[8];
+	for (auto i = 0u; i < 8; ++i)
+		values[i] = std::abs(corner_values[i]) < m_cell_size * 1e-3f ? 0 : corner_values[i];
+
+	for (auto& tetrahedron : tetrahedra) {
+		unsigned in[4], out[4];
+		auto in_count = 0, out_count = 0;
+		for (auto corner : tetrahedron) {
+			if (values[corner] < 0)
+				in[in_count++] = corner;
+			else
+				out[out_count++] = corner;
+		}
+		if (in_count == 0 || out_count == 0)
+			continue;
+
+		auto vertex = [&] (unsigned a, unsigned b) {
+			if ((a & b) != a)
+				std::swap(a, b);
+			if (values[a] == 0 || values[b] == 0) {
+				auto corner = origin + corner_offset(values[a] == 0 ? a : b);
+				part.vertices.emplace_back(corner_index(corner) * 8, position(corner));
+				return part.vertices.back();
+			}
+			auto key = corner_index(origin + corner_offset(a)) * 8 + (a ^ b);
+			auto t = values[a] / (values[a] - values[b]);
+			auto p = glm::mix(position(origin + corner_offset(a)), position(origin + corner_offset(b)), t);
+			part.vertices.emplace_back(key, p);
+			return part.vertices.back();
+		};
+
+		// faces point from the inside corners to the outside
+		auto inside = position(origin + corner_offset(in[0]));
+		auto triangle = [&] (std::pair<std::uint64_t, glm::vec3> a, std::pair<std::uint64_t, glm::vec3> b, std::pair<std::uint64_t, glm::vec3> c) {
+			auto n = glm::cross(b.second - a.second, c.second - a.second);
+			if (glm::dot(n, (a.second + b.second + c.second) / 3.f - inside) < 0)
+				std::swap(b, c);
+			part.triangles.insert(part.triangles.end(), {a.first, b.first, c.first});
+		};
+
+		if (in_count == 1) {
+			triangle(vertex(in[0], out[0]), vertex(in[0], out[1]), vertex(in[0], out[2]));
+		} else if (in_count == 3) {
+			triangle(vertex(in[0], out[0]), vertex(in[1], out[0]), vertex(in[2], out[0]));
+		} else {
+			auto a = vertex(in[0], out[0]), b = vertex(in[0], out[1]);
+			auto c = vertex(in[1], out[1]), d = vertex(in[1], out[0]);
+			triangle(a, b, c);
+			triangle(a, c, d);
+		}
+	}
+}
+
+Mesher::Mesh Mesher::merge(std::vector<Part>& parts)
+{
+	auto mesh = Mesh();
+	auto indices = std::unordered_map<std::uint64_t, unsigned>();
+	m_evaluations = 0;
+
+	for (auto& part : parts) {
+		m_evaluations += part.evaluations;
+		for (auto& [key, p] : part.vertices) {
+			if (indices.emplace(key, mesh.positions.size()).second)
+				mesh.positions.push_back(p);
+		}
+		for (auto i = 0ul; i < part.triangles.size(); i += 3) {
+			auto t = glm::uvec3(
+				indices[part.triangles[i]],
+				indices[part.triangles[i + 1]],
+				indices[part.triangles[i + 2]]);
+			// triangles with two vertices on the same surface corner have no area
+			if (t.x != t.y && t.y != t.z && t.z != t.x)
+				mesh.triangles.push_back(t);
+		}
+		part = Part();
+	}
+
+	mesh.normals.resize(mesh.positions.size());
+	auto chunk_size = 1024u;
+	m_pool.parallel((mesh.positions.size() + chunk_size - 1) / chunk_size, [&] (unsigned chunk) {
+		auto end = std::min<std::size_t>(mesh.positions.size(), (chunk + 1) * chunk_size);
+		for (auto i = chunk * chunk_size; i < end; ++i)
+			mesh.normals[i] = m_rays.normal(mesh.positions[i]);
+	});
+
+	return mesh;
+}
+
+Mesher::Mesh Mesher::sparse()
+{
+	// split the octree into enough subtrees to keep every thread busy
+	auto level = 0u;
+	while ((1u << (3 * level)) < m_pool.thread_count() * 8 && (m_resolution >> level) > 1)
+		++level;
+
+	auto size = m_resolution >> level;
+	auto count = 1u << level;
+	auto parts = std::vector<Part>(count * count * count);
+	m_pool.parallel(parts.size(), [&] (unsigned i) {
+		auto origin = glm::uvec3(i % count, i / count % count, i / count / count) * size;
+		descend(origin, size, parts[i]);
+	});
+
+	return merge(parts);
+}
+
+Mesher::Mesh Mesher::dense()
+{
+	auto n = m_resolution + 1;
+	auto values = std::vector<float>(static_cast<std::size_t>(n) * n * n);
+	m_pool.parallel(n, [&] (unsigned z) {
+		for (auto y = 0u; y < n; ++y)
+			for (auto x = 0u; x < n; ++x)
+				values[corner_index(glm::uvec3(x, y, z))] = m_rays.scene(position(glm::uvec3(x, y, z)));
+	});
+
+	auto parts = std::vector<Part>(m_resolution);
+	m_pool.parallel(m_resolution, [&] (unsigned z) {
+		for (auto y = 0u; y < m_resolution; ++y) {
+			for (auto x = 0u; x < m_resolution; ++x) {
+				auto origin = glm::uvec3(x, y, z);
+				float cell[8];
+				for (auto i = 0u; i < 8; ++i)
+					cell[i] = values[corner_index(origin + corner_offset(i))];
+				polygonize(origin, cell, parts[z]);
+			}
+		}
+	});
+
+	auto mesh = merge(parts);
+	m_evaluations = values.size();
+	return mesh;
+}
+
+bool writeObj(const std::string& filepath, const Mesher::Mesh& mesh)
+{
+	std::ofstream fstream(filepath);
+	if (!fstream.is_open())
+	{
+		std::cout << "Unable to open file '" << filepath << "'" << std::endl;
+		return false;
+	}
+
+	for (auto& p : mesh.positions)
+		fstream << "v " << p.x << ' ' << p.y << ' ' << p.z << '\n';
+	for (auto& n : mesh.normals)
+		fstream << "vn " << n.x << ' ' << n.y << ' ' << n.z << '\n';
+	for (auto t : mesh.triangles) {
+		t += 1u;
+		fstream << "f " << t.x << "//" << t.x << ' ' << t.y << "//" << t.y << ' ' << t.z << "//" << t.z << '\n';
+	}
+
+	return true;
+}
+
+bool writePly(const std::string& filepath, const Mesher::Mesh& mesh)
+{
+	std::ofstream fstream(filepath, std::ios::binary);
+	if (!fstream.is_open())
+	{
+		std::cout << "Unable to open file '" << filepath << "'" << std::endl;
+		return false;
+	}
+
+	fstream << "ply\nformat binary_little_endian 1.0\n"
+		<< "element vertex " << mesh.positions.size() << '\n'
+		<< "property float x\nproperty float y\nproperty float z\n"
+		<< "property float nx\nproperty float ny\nproperty float nz\n"
+		<< "element face " << mesh.triangles.size() << '\n'
+		<< "property list uchar uint vertex_indices\nend_header\n";
+
+	for (auto i = 0ul; i < mesh.positions.size(); ++i) {
+		float vertex[] = {
+			mesh.positions[i].x, mesh.positions[i].y, mesh.positions[i].z,
+			mesh.normals[i].x, mesh.normals[i].y, mesh.normals[i].z,
+		};
+		fstream.write(reinterpret_cast<const char*>(vertex), sizeof (vertex));
+	}
+	for (auto& t : mesh.triangles) {
+		char count = 3;
+		std::uint32_t face[] = {t.x, t.y, t.z};
+		fstream.write(&count, 1);
+		fstream.write(reinterpret_cast<const char*>(face), sizeof (face));
+	}
+
+	return true;
+}
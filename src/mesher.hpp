@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "parallel.hpp"
+#include "rays.hpp"
+
+/*
+ * polygonizes the sdf of a scene into an indexed triangle mesh.
+ * the bounds are divided into a grid of 2^depth cells per axis. sparse() walks an octree
+ * over the grid and skips every cell whose distance exceeds the cell diagonal, so only
+ * a narrow band around the surface is evaluated, in bricks of brick_size cells per axis.
+ * dense() evaluates every grid corner
+ * and exists for comparison. cells are split into six tetrahedra along their main
+ * diagonal and polygonized with marching tetrahedra, which needs no lookup tables
+ * and leaves no cracks between neighbouring cells
+ */
+class Mesher {
+public:
+	struct Mesh {
+		std::vector<glm::vec3> positions;
+		std::vector<glm::vec3> normals;
+		std::vector<glm::uvec3> triangles;
+	};
+
+	Mesher(const Rays& rays, glm::vec3 lo, glm::vec3 hi, unsigned depth, unsigned thread_count = 0);
+
+	Mesh sparse();
+	Mesh dense();
+
+	unsigned long m_evaluations = 0; // scene() calls of the last run
+
+	static constexpr unsigned brick_size = 4;
+
+private:
+	// triangles of one thread, vertices keyed by the grid edge they lie on
+	struct Part {
+		std::vector<std::uint64_t> triangles;
+		std::vector<std::pair<std::uint64_t, glm::vec3>> vertices;
+		unsigned long evaluations = 0;
+	};
+
+	glm::vec3 position(glm::uvec3 corner) const;
+	std::uint64_t corner_index(glm::uvec3 corner) const;
+	void descend(glm::uvec3 origin, unsigned size, Part& part) const;
+	void polygonize(glm::uvec3 origin, const float corner_values[8], Part& part) const;
+	Mesh merge(std::vector<Part>& parts);
+
+	const Rays& m_rays;
+	glm::vec3 m_lo;
+	float m_cell_size;
+	unsigned m_resolution;
+	ThreadPool m_pool;
+};
+
+bool writeObj(const std::string& filepath, const Mesher::Mesh& mesh);
+bool writePly(const std::string& filepath, const Mesher::Mesh& mesh);
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * long lived worker threads for data parallel loops. parallel() hands the indices of
+ * one loop out to the workers and the calling thread, and returns once all are done.
+ * the threads are started once, so a loop costs a wake up instead of thread creation
+ */
+class ThreadPool {
+public:
+	// thread_count includes the calling thread, 0 uses every core
+	explicit ThreadPool(unsigned thread_count = 0)
+		: m_thread_count(thread_count ? thread_count : std::max(1u, std::thread::hardware_concurrency()))
+	{
+		for (auto i = 1u; i < m_thread_count; ++i)
+			m_threads.emplace_back([this] (std::stop_token stop_token) { work(stop_token); });
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator= (const ThreadPool&) = delete;
+
+	unsigned thread_count() const { return m_thread_count; }
+
+	// call f(i) for every i < count, spread over all threads
+	template <typename F>
+	void parallel(unsigned count, F f)
+	{
+		if (count == 0)
+			return;
+
+		{
+			auto lock = std::lock_guard(m_mutex);
+			m_job = [&f] (unsigned i) { f(i); };
+			m_count = count;
+			m_next = 0;
+			m_busy = m_threads.size();
+			++m_generation;
+		}
+		m_wake.notify_all();
+
+		run();
+
+		auto lock = std::unique_lock(m_mutex);
+		m_done.wait(lock, [this] { return m_busy == 0; });
+		m_job = nullptr;
+	}
+
+private:
+	void run()
+	{
+		for (auto i = m_next++; i < m_count; i = m_next++)
+			m_job(i);
+	}
+
+	void work(std::stop_token stop_token)
+	{
+		auto generation = 0ul;
+		auto lock = std::unique_lock(m_mutex);
+		while (m_wake.wait(lock, stop_token, [&] { return m_generation != generation; })) {
+			generation = m_generation;
+			lock.unlock();
+			run();
+			lock.lock();
+			if (--m_busy == 0)
+				m_done.notify_one();
+		}
+	}
+
+	unsigned m_thread_count;
+
+	std::mutex m_mutex;
+	std::condition_variable_any m_wake;
+	std::condition_variable m_done;
+	std::function<void(unsigned)> m_job;
+	unsigned m_count = 0;
+	std::atomic<unsigned> m_next = 0;
+	std::size_t m_busy = 0;
+	unsigned long m_generation = 0;
+
+	std::vector<std::jthread> m_threads;
+};
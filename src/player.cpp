@@ -1,17 +1,17 @@
 #include "player.hpp"
 #include <glm/gtc/matrix_transform.hpp>
 
-void Player::update(std::chrono::milliseconds delta_time)
+void Player::update(std::chrono::milliseconds delta_time, const PlayerInput::Sample& input)
 {
-	m_dir = m_input.front();
-	auto local_move_dir = m_input.local_move_dir();
-	m_vel = local_move_dir.x * m_input.move_right()
-		+ local_move_dir.y * m_input.move_up()
-		- local_move_dir.z * m_input.move_front();
+	m_dir = input.front;
+	auto local_move_dir = input.local_move_dir;
+	m_vel = local_move_dir.x * input.move_right
+		+ local_move_dir.y * input.move_up
+		- local_move_dir.z * input.move_front;
 	m_vel *= .05f;
 	m_pos += m_vel;
 
-	if (m_input.shooting()) {
+	if (input.shooting) {
 
 	}
 }
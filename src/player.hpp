@@ -5,10 +5,9 @@
 
 class Player {
 public:
-	void update(std::chrono::milliseconds delta_time);
+	void update(std::chrono::milliseconds delta_time, const PlayerInput::Sample& input);
 
 	glm::vec3 m_pos;
 	glm::vec3 m_dir;
 	glm::vec3 m_vel;
-	PlayerInput m_input;
 };
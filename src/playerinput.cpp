@@ -1,104 +1,53 @@
 #include "playerinput.hpp"
+#include <bit>
+#include <cstdint>
+#include <fstream>
 #include <iostream>
+#include <random>
 
-glm::vec3 PlayerInput::front()
+PlayerInput::Sample PlayerInput::sample(const InputSnapshot& input)
 {
-	auto mouse_pos = glm::vec2(mouse_x(), mouse_y());
-	return glm::normalize(
-		glm::vec3(glm::sin(mouse_pos.x) * glm::cos(mouse_pos.y),
-		glm::sin(mouse_pos.y),
-		glm::cos(mouse_pos.x) * glm::cos(mouse_pos.y))
-	);
-}
+	auto sample = read(input);
 
-glm::vec3 PlayerInput::right()
-{
-	return glm::normalize(
-		glm::cross(
-			front(),
-			glm::vec3(0, 1, 0)
-		)
+	sample.front = glm::normalize(
+		glm::vec3(glm::sin(sample.mouse_x) * glm::cos(sample.mouse_y),
+		glm::sin(sample.mouse_y),
+		glm::cos(sample.mouse_x) * glm::cos(sample.mouse_y))
 	);
-}
+	sample.right = glm::normalize(glm::cross(sample.front, glm::vec3(0, 1, 0)));
+	sample.up = glm::normalize(glm::cross(sample.right, sample.front));
 
-glm::vec3 PlayerInput::up()
-{
-	return glm::normalize(
-		glm::cross(
-			right(),
-			front()
-		)
-	);
-}
-
-glm::vec3 PlayerInput::local_move_dir()
-{
-	return glm::vec3(
-		moving_right() - moving_left(),
+	sample.local_move_dir = glm::vec3(
+		sample.moving_right - sample.moving_left,
 		0,
-		moving_backward() - moving_forward()
+		sample.moving_backward - sample.moving_forward
 	);
-}
-
-glm::vec3 PlayerInput::move_front()
-{
-	auto dir = front();
-	return glm::normalize(glm::vec3(dir.x, 0, dir.z));
-}
-
-glm::vec3 PlayerInput::move_right()
-{
-	auto dir = right();
-	return glm::normalize(glm::vec3(dir.x, 0, dir.z));
-}
-
-glm::vec3 PlayerInput::move_up()
-{
-	return glm::vec3(0, 1, 0);
-}
 
-std::set<int> PlayerInput::jids;
-void PlayerInput::jid_callback(int jid, int event)
-{
-	if (event == GLFW_CONNECTED) {
-		jids.insert(jid);
-		std::cout << "joystick connected" << std::endl;
-	}
-	else if (event == GLFW_DISCONNECTED) {
-		jids.erase(jid);
-		std::cout << "joystick disconnected" << std::endl;
-	}
+	sample.move_front = glm::normalize(glm::vec3(sample.front.x, 0, sample.front.z));
+	sample.move_right = glm::normalize(glm::vec3(sample.right.x, 0, sample.right.z));
+	sample.move_up = glm::vec3(0, 1, 0);
 
-	std::cout << "with name: " << glfwGetJoystickName(jid) << std::endl;
-	if (glfwJoystickIsGamepad(jid)) {
-		std::cout << "is a gamepad with name: " << glfwGetGamepadName(jid) << std::endl;
-	}
+	return sample;
 }
 
-PlayerInput PlayerInput::createKeyboardInput(GLFWwindow* window)
+PlayerInput PlayerInput::createKeyboardInput()
 {
 	return PlayerInput{
-		.moving_left = [=] { return glfwGetKey(window, GLFW_KEY_A) ? 1.f : 0.f; },
-		.moving_right = [=] { return glfwGetKey(window, GLFW_KEY_D) ? 1.f : 0.f; },
-		.moving_forward = [=] { return glfwGetKey(window, GLFW_KEY_W) ? 1.f : 0.f; },
-		.moving_backward = [=] { return glfwGetKey(window, GLFW_KEY_S) ? 1.f : 0.f; },
-		.jumping = [=] { return glfwGetKey(window, GLFW_KEY_SPACE) ? 1.f : 0.f; },
-		.shooting = [=] { return glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_1) ? 1.f : 0.f; },
-		.mouse_x = [=] {
-			double x, y;
-			glfwGetCursorPos(window, &x, &y);
-			int w, h;
-			glfwGetWindowSize(window, &w, &h);
-			auto m = -glm::pi<float>() * (x - w * .5) / h;
-			return static_cast<float>(m);
-		},
-		.mouse_y= [=] {
-			double x, y;
-			glfwGetCursorPos(window, &x, &y);
-			int w, h;
-			glfwGetWindowSize(window, &w, &h);
-			auto m = -glm::pi<float>() * (y - h * .5) / h;
-			return static_cast<float>(m);
+		.read = [] (const InputSnapshot& input) {
+			auto key = [&] (int key) { return input.keys[key] ? 1.f : 0.f; };
+			auto m = -glm::pi<float>() * glm::vec2(input.cursor - glm::dvec2(input.window_size) * .5)
+				/ static_cast<float>(input.window_size.y);
+
+			return Sample{
+				.moving_left = key(GLFW_KEY_A),
+				.moving_right = key(GLFW_KEY_D),
+				.moving_forward = key(GLFW_KEY_W),
+				.moving_backward = key(GLFW_KEY_S),
+				.jumping = key(GLFW_KEY_SPACE),
+				.shooting = input.mouse_buttons[GLFW_MOUSE_BUTTON_1] ? 1.f : 0.f,
+				.mouse_x = m.x,
+				.mouse_y = m.y,
+			};
 		},
 	};
 }
@@ -118,31 +67,6 @@ PlayerInput PlayerInput::createGamepadInput(int index)
 		axis_right_y = GLFW_GAMEPAD_AXIS_RIGHT_Y,
 	};
 
-	auto jid = [&] (int index) {
-		int count = 0;
-		for (int jid : jids)
-			if (glfwJoystickIsGamepad(jid))
-				if (index == count++)
-					return jid;
-		return -1;
-	};
-
-	auto button = [&] (int id, int jid) {
-		if (jid == -1)
-			return 0;
-		GLFWgamepadstate state;
-		glfwGetGamepadState(jid, &state);
-		return static_cast<int>(state.buttons[id]);
-	};
-
-	auto axis = [&] (int id, int jid) {
-		if (jid == -1)
-			return 0.f;
-		GLFWgamepadstate state;
-		glfwGetGamepadState(jid, &state);
-		return static_cast<float>(state.axes[id]);
-	};
-
 	auto smoothstep = [] (float a, float b, float v) {
 		return glm::clamp((v - a) / (b - a), 0.f, 1.f);
 	};
@@ -164,34 +88,162 @@ PlayerInput PlayerInput::createGamepadInput(int index)
 	};
 
 	return PlayerInput{
-		.moving_left = [=] {
-			return button(left, jid(index)) ? 1.f :
-				axis_smoothstep(-axis(axis_left_x, jid(index)));
-		},
-		.moving_right = [=] {
-			return button(right, jid(index)) ? 1.f :
-				axis_smoothstep(axis(axis_left_x, jid(index)));
-		},
-		.moving_forward = [=] {
-			return button(forward, jid(index)) ? 1.f :
-				axis_smoothstep(-axis(axis_left_y, jid(index)));
-		},
-		.moving_backward = [=] {
-			return button(backward, jid(index)) ? 1.f :
-				axis_smoothstep(axis(axis_left_y, jid(index)));
+		.read = [=] (const InputSnapshot& input) mutable {
+			if (index >= input.gamepad_count)
+				return Sample{
+					.mouse_x = -glm::pi<float>() * mouse.x,
+					.mouse_y = -glm::pi<float>() * mouse.y,
+				};
+
+			auto& state = input.gamepads[index];
+			auto button = [&] (int id) { return static_cast<int>(state.buttons[id]); };
+			auto axis = [&] (int id) { return static_cast<float>(state.axes[id]); };
+
+			mouse.x += .005f * axis_abs_smoothstep(axis(axis_right_x));
+			mouse.y += .005f * axis_abs_smoothstep(axis(axis_right_y));
+			mouse.y = glm::clamp(mouse.y, -.45f, .45f);
+
+			return Sample{
+				.moving_left = button(left) ? 1.f : axis_smoothstep(-axis(axis_left_x)),
+				.moving_right = button(right) ? 1.f : axis_smoothstep(axis(axis_left_x)),
+				.moving_forward = button(forward) ? 1.f : axis_smoothstep(-axis(axis_left_y)),
+				.moving_backward = button(backward) ? 1.f : axis_smoothstep(axis(axis_left_y)),
+				.jumping = button(jump) ? 1.f : 0.f,
+				.shooting = button(jump) ? 1.f : 0.f,
+				.mouse_x = -glm::pi<float>() * mouse.x,
+				.mouse_y = -glm::pi<float>() * mouse.y,
+			};
 		},
-		.jumping = [=] { return button(jump, jid(index)) ? 1.f : 0.f; },
-		.shooting = [=] { return button(jump, jid(index)) ? 1.f : 0.f; },
-		.mouse_x = [=] () mutable {
-			mouse.x += .005f * axis_abs_smoothstep(axis(axis_right_x, jid(index)));
-			auto m = -glm::pi<float>() * mouse.x;
-			return static_cast<float>(m);
+	};
+};
+
+// wanders around deterministically for a given seed, no device is read
+PlayerInput PlayerInput::createBotInput(unsigned seed)
+{
+	auto rng = std::minstd_rand(seed);
+	auto sample = Sample{};
+	auto turn = 0.f;
+	auto ticks = 0;
+
+	return PlayerInput{
+		.read = [=] (const InputSnapshot&) mutable {
+			auto random = [&] { return static_cast<float>(rng() % 1024) / 1024.f; };
+			if (ticks-- <= 0) {
+				ticks = 30 + static_cast<int>(random() * 90);
+				turn = (random() - .5f) * .05f;
+				sample.moving_forward = random() < .8f ? 1.f : 0.f;
+				sample.moving_left = random() < .2f ? 1.f : 0.f;
+				sample.moving_right = random() < .2f ? 1.f : 0.f;
+				sample.jumping = random() < .1f ? 1.f : 0.f;
+				sample.shooting = random() < .3f ? 1.f : 0.f;
+			}
+			sample.mouse_x += turn;
+			return sample;
 		},
-		.mouse_y = [=] () mutable {
-			mouse.y += .005f * axis_abs_smoothstep(axis(axis_right_y, jid(index)));
-			mouse.y = glm::clamp(mouse.y, -.45f, .45f);
-			auto m = -glm::pi<float>() * mouse.y;
-			return static_cast<float>(m);
+	};
+}
+
+// plays back one player of a recording and stands still after its end
+PlayerInput PlayerInput::createReplayInput(std::shared_ptr<const Recording> recording, std::size_t player)
+{
+	auto tick = 0ul;
+
+	return PlayerInput{
+		.read = [=] (const InputSnapshot&) mutable {
+			auto& samples = *recording;
+			if (samples.empty())
+				return Sample{};
+			auto i = std::min(tick++, samples.size() - 1);
+			if (player >= samples[i].size())
+				return Sample{};
+			auto sample = samples[i][player];
+			if (tick > samples.size())
+				sample.moving_left = sample.moving_right = sample.moving_forward = sample.moving_backward = 0;
+			return sample;
 		},
 	};
+}
+
+/*
+ * little endian binary. "MSIN", player count, then per tick and player the eight
+ * raw floats of raw_fields
+ */
+static float PlayerInput::Sample::* const raw_fields[] = {
+	&PlayerInput::Sample::moving_left, &PlayerInput::Sample::moving_right,
+	&PlayerInput::Sample::moving_forward, &PlayerInput::Sample::moving_backward,
+	&PlayerInput::Sample::jumping, &PlayerInput::Sample::shooting,
+	&PlayerInput::Sample::mouse_x, &PlayerInput::Sample::mouse_y,
 };
+
+static void writeLittleEndian(std::ostream& stream, std::uint32_t value)
+{
+	char bytes[4];
+	for (auto i = 0; i < 4; ++i)
+		bytes[i] = static_cast<char>(value >> (8 * i));
+	stream.write(bytes, 4);
+}
+
+static bool readLittleEndian(std::istream& stream, std::uint32_t& value)
+{
+	unsigned char bytes[4];
+	if (!stream.read(reinterpret_cast<char*>(bytes), 4))
+		return false;
+	value = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | std::uint32_t(bytes[3]) << 24;
+	return true;
+}
+bool writeRecording(const std::string& filepath, const PlayerInput::Recording& recording)
+{
+	std::ofstream fstream(filepath, std::ios::binary);
+	if (!fstream.is_open())
+	{
+		std::cout << "Unable to open file '" << filepath << "'" << std::endl;
+		return false;
+	}
+
+	auto player_count = static_cast<std::uint32_t>(recording.empty() ? 0 : recording[0].size());
+	fstream.write("MSIN", 4);
+	writeLittleEndian(fstream, player_count);
+	for (auto& samples : recording) {
+		for (auto i = 0u; i < player_count; ++i) {
+			auto sample = i < samples.size() ? samples[i] : PlayerInput::Sample{};
+			for (auto field : raw_fields)
+				writeLittleEndian(fstream, std::bit_cast<std::uint32_t>(sample.*field));
+		}
+	}
+
+	return true;
+}
+
+bool readRecording(const std::string& filepath, PlayerInput::Recording& recording)
+{
+	std::ifstream fstream(filepath, std::ios::binary);
+	if (!fstream.is_open())
+	{
+		std::cout << "Unable to open file '" << filepath << "'" << std::endl;
+		return false;
+	}
+
+	char magic[4] = {};
+	auto player_count = std::uint32_t(0);
+	fstream.read(magic, 4);
+	if (!readLittleEndian(fstream, player_count) || std::string(magic, 4) != "MSIN")
+	{
+		std::cout << "Invalid recording '" << filepath << "'" << std::endl;
+		return false;
+	}
+
+	recording.clear();
+	while (true) {
+		auto samples = std::vector<PlayerInput::Sample>(player_count);
+		auto value = std::uint32_t(0);
+		for (auto& sample : samples)
+			for (auto field : raw_fields)
+				if (readLittleEndian(fstream, value))
+					sample.*field = std::bit_cast<float>(value);
+		if (!fstream)
+			break;
+		recording.push_back(std::move(samples));
+	}
+
+	return true;
+}
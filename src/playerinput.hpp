@@ -1,46 +1,57 @@
 #pragma once
 
 #include <functional>
-#include <set>
 #include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
 #include <glm/glm.hpp>
-#include <GL/glew.h>
-#include <GLFW/glfw3.h>
 #include <glm/ext/scalar_constants.hpp>
+#include "input.hpp"
 
 class PlayerInput {
-	static float noop() { return 0; }
-
 public:
-	using GetF = std::function<float()>;
-
-	// look directions
-	glm::vec3 front();
-	glm::vec3 right();
-	glm::vec3 up();
-
-	glm::vec3 local_move_dir(); // move dir without respect to look direction
-
-	// move dir with respect to look direction
-	glm::vec3 move_front();
-	glm::vec3 move_right();
-	glm::vec3 move_up();
-
-	// input
-	GetF moving_left = noop;
-	GetF moving_right = noop;
-	GetF moving_forward = noop;
-	GetF moving_backward = noop;
-	GetF jumping = noop;
-	GetF shooting = noop;
-	GetF mouse_x = noop;
-	GetF mouse_y = noop;
-
-	static void jid_callback(int jid, int event);
-
-	static PlayerInput createKeyboardInput(GLFWwindow* window);
+	// plain input values of one player for one tick. the look and move directions
+	// are derived once in sample(), so the simulation only reads fields
+	struct Sample {
+		float moving_left = 0;
+		float moving_right = 0;
+		float moving_forward = 0;
+		float moving_backward = 0;
+		float jumping = 0;
+		float shooting = 0;
+		float mouse_x = 0;
+		float mouse_y = 0;
+
+		// look directions
+		glm::vec3 front = {0, 0, 1};
+		glm::vec3 right = {-1, 0, 0};
+		glm::vec3 up = {0, 1, 0};
+
+		glm::vec3 local_move_dir = {0, 0, 0}; // move dir without respect to look direction
+
+		// move dir with respect to look direction
+		glm::vec3 move_front = {0, 0, 1};
+		glm::vec3 move_right = {-1, 0, 0};
+		glm::vec3 move_up = {0, 1, 0};
+	};
+
+	// maps the device state to the raw input values of a player
+	using ReadF = std::function<Sample(const InputSnapshot&)>;
+
+	// the samples of every player for every tick, see writeRecording()
+	using Recording = std::vector<std::vector<Sample>>;
+
+	Sample sample(const InputSnapshot& input);
+
+	ReadF read = [] (const InputSnapshot&) { return Sample{}; };
+
+	static PlayerInput createKeyboardInput();
 	static PlayerInput createGamepadInput(int index);
-
-private:
-	static std::set<int> jids;
+	static PlayerInput createBotInput(unsigned seed);
+	static PlayerInput createReplayInput(std::shared_ptr<const Recording> recording, std::size_t player);
 };
+
+// only the raw input values are stored, sample() derives the rest again
+bool writeRecording(const std::string& filepath, const PlayerInput::Recording& recording);
+bool readRecording(const std::string& filepath, PlayerInput::Recording& recording);
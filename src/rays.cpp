@@ -3,6 +3,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/ext/scalar_constants.hpp>
 #include "misc.hpp"
+#include "interval.hpp"
 
 /*
  * this class is basically a mirror to the shader, to make equivalent calls
@@ -20,7 +21,7 @@ mat3 Rays::look_at(vec3 d)
 	return mat3(r, u, d);
 }
 
-mat2 Rays::rotateXY(float a)
+mat2 Rays::rotateXY(float a) const
 {
 	return mat2(
 		cos(a), -sin(a),
@@ -28,49 +29,49 @@ mat2 Rays::rotateXY(float a)
 	);
 }
 
-float Rays::sphere(vec3 p, float r)
+float Rays::sphere(vec3 p, float r) const
 {
 	return length(p) - r;
 }
 
-float Rays::roundcube(vec3 p, vec2 r)
+float Rays::roundcube(vec3 p, vec2 r) const
 {
 	return length(max(abs(p) - (r.x - r.y), vec3(0))) - r.y;
 }
 
-float Rays::roundcube(vec3 p, vec4 r)
+float Rays::roundcube(vec3 p, vec4 r) const
 {
 	return length(max(abs(p) - (xyz(r) - r.w), vec3(0))) - r.w;
 }
 
-float Rays::cube(vec3 p, float r)
+float Rays::cube(vec3 p, float r) const
 {
 	return roundcube(p, vec2(r, .0));
 }
 
-float Rays::cube(vec3 p, vec3 r)
+float Rays::cube(vec3 p, vec3 r) const
 {
 	return roundcube(p, vec4(r, 0));
 }
 
-float Rays::quickcube(vec3 p, float r)
+float Rays::quickcube(vec3 p, float r) const
 {
 	p = abs(p);
 	return max(p.x, max(p.y, p.z)) - r;
 }
 
-float Rays::quickcube(vec3 p, vec3 r)
+float Rays::quickcube(vec3 p, vec3 r) const
 {
 	p = abs(p);
 	return max(p.x - r.x, max(p.y - r.y, p.z - r.z));
 }
 
-float Rays::plane(vec3 p, vec3 n, float r)
+float Rays::plane(vec3 p, vec3 n, float r) const
 {
 	return dot(p, n) - r;
 }
 
-float Rays::line(vec3 p, vec3 a, vec3 b, float r)
+float Rays::line(vec3 p, vec3 a, vec3 b, float r) const
 {
 	vec3 ab = b - a;
 	vec3 ap = p - a;
@@ -78,62 +79,263 @@ float Rays::line(vec3 p, vec3 a, vec3 b, float r)
 	return length(ap - h * ab) - r;
 }
 
-float Rays::torus(vec3 p, vec2 r)
+float Rays::torus(vec3 p, vec2 r) const
 {
 	vec3 p0 = normalize(vec3(xy(p), 0.f)) * r.x;
 	return length(p0 - p) - r.y;
 }
 
-float Rays::onion(float d, float thickness)
+float Rays::onion(float d, float thickness) const
 {
 	return abs(d + thickness) - thickness;
 }
 
-vec3 Rays::alongate(vec3 p, vec3 a, vec3 b)
+vec3 Rays::alongate(vec3 p, vec3 a, vec3 b) const
 {
 	return max(min(p, a), p - b);
 }
 
-float Rays::scene(vec3 p)
+Interval Rays::roundcube(Interval3 p, vec4 r) const
 {
+	return length(max(abs(p) - (xyz(r) - r.w), 0.f)) - r.w;
+}
+
+Interval Rays::quickcube(Interval3 p, vec3 r) const
+{
+	p = abs(p);
+	return max(p.x - r.x, max(p.y - r.y, p.z - r.z));
+}
+
+Interval Rays::plane(Interval3 p, vec3 n, float r) const
+{
+	return dot(p, n) - r;
+}
+
+float Rays::level_primitive(vec3 p, const Level::Primitive& q) const
+{
+	if (q.pos.w == 0.)
+		return roundcube(p - xyz(q.pos), q.size);
+	return sphere(p - xyz(q.pos), q.size.w);
+}
+
+// trilinear interpolation of the baked samples, the distance to the brick outside of it
+float Rays::level_brick(vec3 p, const Level::Brick& b, const std::vector<float>& samples) const
+{
+	vec3 half_size = vec3(b.lo_size.w * .5f);
+	float outside = cube(p - xyz(b.lo_size) - half_size, half_size);
+	if (outside > 0.)
+		return outside;
+
+	unsigned n = b.samples.y;
+	vec3 g = clamp((p - xyz(b.lo_size)) / b.lo_size.w * float(n - 1u), vec3(0), vec3(float(n - 1u) - .001f));
+	uvec3 i = uvec3(g);
+	vec3 f = g - vec3(i);
+	unsigned o = b.samples.x + i.x + n * (i.y + n * i.z);
+	float c00 = mix(samples[o], samples[o + 1u], f.x);
+	float c10 = mix(samples[o + n], samples[o + n + 1u], f.x);
+	float c01 = mix(samples[o + n * n], samples[o + n * n + 1u], f.x);
+	float c11 = mix(samples[o + n * n + n], samples[o + n * n + n + 1u], f.x);
+	return mix(mix(c00, c10, f.y), mix(c01, c11, f.y), f.z);
+}
+
+// distance to the content of one chunk if it is resident and closer than d
+float Rays::level_chunk(vec3 p, ivec3 coord, float d) const
+{
+	auto& view = *snapshot->level;
+	int slot = view.find(coord);
+	if (slot < 0)
+		return d;
+
+	auto& chunk = *view.slots[slot];
+	for (auto& q : chunk.primitives)
+		d = min(d, level_primitive(p, q));
+	for (auto& b : chunk.bricks)
+		d = min(d, level_brick(p, b, chunk.samples));
+	return d;
+}
+
+/*
+ * every primitive lies inside its chunk, so everything outside of the chunks around p
+ * is at least chunk_size away and the neighbourhood is enough for a distance bound.
+ * the chunk of p goes first, then only the neighbours closer than the distance so far
+ */
+float Rays::level(vec3 p) const
+{
+	float size = snapshot->level->chunk_size;
+	ivec3 c = ivec3(floor(p / size));
+	vec3 f = p - vec3(c) * size;
+	float d = level_chunk(p, c, size);
+
+	ivec3 lo = ivec3(f.x < d ? -1 : 0, f.y < d ? -1 : 0, f.z < d ? -1 : 0);
+	ivec3 hi = ivec3(f.x > size - d ? 1 : 0, f.y > size - d ? 1 : 0, f.z > size - d ? 1 : 0);
+	vec3 half_size = vec3(size * .5f);
+	for (int z = lo.z; z <= hi.z; ++z) {
+		for (int y = lo.y; y <= hi.y; ++y) {
+			for (int x = lo.x; x <= hi.x; ++x) {
+				ivec3 o = ivec3(x, y, z);
+				if (o != ivec3(0) && cube(p - vec3(c + o) * size - half_size, half_size) < d)
+					d = level_chunk(p, c + o, d);
+			}
+		}
+	}
+	return d;
+}
+
+float Rays::scene(vec3 p) const
+{
+	return scene(p, scene_all);
+}
+
+void Rays::Snapshot::prepare()
+{
+	for (int i = 0; i < 4; ++i) {
+		vec3 d = vec3(players[i].dir.x, 0, players[i].dir.z) * .5f;
+		float dl = .5 - clamp(-players[i].dir.y * .7f, 0.f, .5f);
+		entities[i].enabled = players[i].pos.w == 1;
+		entities[i].to_local = length(d) > 0 ? inverse(look_at(normalize(d))) : mat3(1);
+		entities[i].pos = xyz(players[i].pos);
+		entities[i].extents = vec4(max(.05f, dl), .5, .5, .05);
+	}
+}
+
+float Rays::scene(vec3 p, unsigned mask) const
+{
+	auto& entities = snapshot->entities;
 	float c0 = 100.;
 	for (int i = 0; i < 4; ++i) {
-		if (camera_player != i && players[i].pos.w == 1) {
-			vec3 d = vec3(players[i].dir.x, 0, players[i].dir.z) * .5f;
-			float dl = .5 - clamp(-players[i].dir.y * .7f, 0.f, .5f);
-			vec3 cp = inverse(look_at(normalize(d))) * (p - xyz(players[i].pos));
+		if ((mask & 1u << i) && camera_player != i && entities[i].enabled) {
+			vec3 cp = entities[i].to_local * (p - entities[i].pos);
 			// cp.x += length(players[i].vel) * 10. * sin(cp.z * 5. + elapsed_time) * .05;
-			c0 = min(c0, roundcube(cp, vec4(max(.05f, dl), .5, .5, .05)));
+			c0 = min(c0, roundcube(cp, entities[i].extents));
 		}
 	}
 
-	float c1 = quickcube(p, vec3(5, .5, 5));
-	c1 = max(-c1, -plane(p, normalize(vec3(0, -1, 0)), .0));
+	float c1 = 100.;
+	if (snapshot->level) {
+		if (mask & scene_level)
+			c1 = level(p);
+	} else if (mask & scene_arena) {
+		c1 = -100.;
+		if (mask & scene_box)
+			c1 = max(c1, -quickcube(p, vec3(5, .5, 5)));
+		if (mask & scene_floor)
+			c1 = max(c1, -plane(p, normalize(vec3(0, -1, 0)), .0));
+	}
 
 	return min(c0, c1) * .5;
 }
 
-bool Rays::march(vec3 ro, vec3 rd, vec3* p, float* steps)
+/*
+ * bound every term of scene() over the box with interval arithmetic and keep only
+ * those that can still be the minimum (or the maximum inside the arena csg)
+ */
+unsigned Rays::prune(vec3 lo, vec3 hi) const
+{
+	auto& entities = snapshot->entities;
+	auto p = box(lo, hi);
+	const float eps = .001;
+
+	Interval terms[4];
+	float c0_hi = 100.;
+	for (int i = 0; i < 4; ++i) {
+		if (camera_player != i && entities[i].enabled) {
+			Interval3 cp = entities[i].to_local * (p - entities[i].pos);
+			terms[i] = roundcube(cp, entities[i].extents);
+			c0_hi = min(c0_hi, terms[i].hi);
+		}
+	}
+
+	// the level is never pruned, it bounds nothing but keeps the players that are closer
+	if (snapshot->level) {
+		unsigned mask = scene_level;
+		for (int i = 0; i < 4; ++i)
+			if (camera_player != i && entities[i].enabled && terms[i].lo <= c0_hi + eps)
+				mask |= 1u << i;
+		return mask;
+	}
+
+	Interval a = -quickcube(p, vec3(5, .5, 5));
+	Interval b = -plane(p, normalize(vec3(0, -1, 0)), .0);
+	unsigned mask = 0;
+	Interval c1;
+	if (a.hi + eps < b.lo) {
+		mask |= scene_floor;
+		c1 = b;
+	} else if (b.hi + eps < a.lo) {
+		mask |= scene_box;
+		c1 = a;
+	} else {
+		mask |= scene_arena;
+		c1 = max(a, b);
+	}
+
+	float c_hi = min(c0_hi, c1.hi);
+	for (int i = 0; i < 4; ++i)
+		if (camera_player != i && entities[i].enabled && terms[i].lo <= c_hi + eps)
+			mask |= 1u << i;
+	if (c1.lo > c_hi + eps)
+		mask &= ~scene_arena;
+
+	return mask;
+}
+
+/*
+ * fill march_masks for the rays through a tile of pixels. every march segment is
+ * bounded by the hull of the tile corner rays at its near and far distance
+ */
+void Rays::prune_tile(vec2 begin, vec2 end, vec2 output_size)
+{
+	mat3 m = look_at(camera_dir);
+	vec2 corners[4] = {begin - .5f, vec2(end.x, begin.y) + vec2(.5, -.5), vec2(begin.x, end.y) + vec2(-.5, .5), end + .5f};
+	vec3 d[4];
+	vec3 center = vec3(0);
+	for (int i = 0; i < 4; ++i) {
+		vec2 uv = (corners[i] - output_size * .5f) / output_size.y;
+		d[i] = m * normalize(vec3(uv, 1));
+		center += d[i];
+	}
+
+	// a ray between the corners reaches at most 1 / cos_half further out than the corners
+	center = normalize(center);
+	float cos_half = 1.;
+	for (int i = 0; i < 4; ++i)
+		cos_half = min(cos_half, dot(center, d[i]));
+
+	for (int s = 0; s < march_segments; ++s) {
+		float t0 = march_distance * s / march_segments;
+		float t1 = march_distance * (s + 1) / march_segments / cos_half;
+		vec3 lo = camera_pos + d[0] * t0;
+		vec3 hi = lo;
+		for (int i = 0; i < 4; ++i) {
+			lo = min(lo, min(camera_pos + d[i] * t0, camera_pos + d[i] * t1));
+			hi = max(hi, max(camera_pos + d[i] * t0, camera_pos + d[i] * t1));
+		}
+		march_masks[s] = prune(lo, hi);
+	}
+}
+
+bool Rays::march(vec3 ro, vec3 rd, vec3* p, float* steps) const
 {
 	*p = ro;
 	float ol = 0.;
 
 	for (int i = 0; i < 200; ++i) {
-		float l = scene(*p);
+		int segment = clamp(int(ol * (march_segments / march_distance)), 0, march_segments - 1);
+		float l = scene(*p, march_masks[segment]);
 		ol += l;
 		*p = ro + rd * ol;
 		*steps = float(i) / 100.;
 
 		if (l < .01)
 			return true;
-		if (ol > 20.)
+		if (ol > march_distance)
 			return false;
 	}
 
 	return false;
 }
 
-vec3 Rays::normal(vec3 p)
+vec3 Rays::normal(vec3 p) const
 {
 	float l = scene(p);
 	vec2 e = vec2(0, .001);
@@ -146,3 +348,43 @@ vec3 Rays::normal(vec3 p)
 		)
 	);
 }
+
+vec3 Rays::pixel(vec2 output_coord, vec2 output_size, vec4* gbuffer) const
+{
+	vec2 uv = (output_coord - output_size * .5f) / output_size.y;
+	vec3 c = vec3(0);
+
+	vec3 ro = camera_pos;
+	vec3 rd = look_at(camera_dir) * normalize(vec3(uv, 1));
+
+	vec3 p;
+	float steps;
+	bool hit = march(ro, rd, &p, &steps);
+	vec3 n = normal(p);
+	c.g += hit ? dot(rd, -n) : 0.f;
+	c.b += steps;
+	c.g += hit ? 0.f : 1.f - steps;
+
+	*gbuffer = hit ? vec4(n, length(p - ro)) : vec4(0, 0, 0, -1);
+	return c;
+}
+
+bool Rays::edge(vec4 a, vec4 b) const
+{
+	if ((a.w < 0.f) != (b.w < 0.f))
+		return true;
+	if (a.w < 0.f)
+		return false;
+	if (abs(a.w - b.w) > aa_depth_threshold * min(a.w, b.w))
+		return true;
+	return dot(xyz(a), xyz(b)) < aa_normal_threshold;
+}
+
+vec3 Rays::refine(vec2 output_coord, vec2 output_size, vec3 c) const
+{
+	const vec2 offsets[4] = {vec2(.125, .375), vec2(.375, -.125), vec2(-.125, -.375), vec2(-.375, .125)};
+	vec4 gbuffer;
+	for (int i = 0; i < 4; ++i)
+		c += pixel(output_coord + offsets[i], output_size, &gbuffer);
+	return c / 5.f;
+}
@@ -1,26 +1,87 @@
 #pragma once
 
+#include <memory>
 #include <glm/glm.hpp>
+#include "level.hpp"
 
+struct Interval;
+struct Interval3;
+
+/*
+ * the world state is an immutable Snapshot that can be shared between threads.
+ * a Rays object is the per-thread march context on top of it, holding the view
+ * parameters that correspond to the uniforms of the compute shader
+ */
 class Rays {
 public:
-	glm::mat3 look_at(glm::vec3 d);
-	glm::mat2 rotateXY(float a);
-	float sphere(glm::vec3 p, float r);
-	float roundcube(glm::vec3 p, glm::vec2 r);
-	float roundcube(glm::vec3 p, glm::vec4 r);
-	float cube(glm::vec3 p, float r);
-	float cube(glm::vec3 p, glm::vec3 r);
-	float quickcube(glm::vec3 p, float r);
-	float quickcube(glm::vec3 p, glm::vec3 r);
-	float plane(glm::vec3 p, glm::vec3 n, float r);
-	float line(glm::vec3 p, glm::vec3 a, glm::vec3 b, float r);
-	float torus(glm::vec3 p, glm::vec2 r);
-	float onion(float d, float thickness);
-	glm::vec3 alongate(glm::vec3 p, glm::vec3 a, glm::vec3 b);
-	float scene(glm::vec3 p);
-	bool march(glm::vec3 ro, glm::vec3 rd, glm::vec3* p, float* steps);
-	glm::vec3 normal(glm::vec3 p);
+	struct Player {
+		glm::vec4 pos;
+		glm::vec4 dir;
+		glm::vec4 vel;
+	};
+
+	// per frame invariants of a player in scene(), see Snapshot::prepare()
+	struct Entity {
+		glm::mat3 to_local;
+		glm::vec3 pos;
+		glm::vec4 extents;
+		bool enabled;
+	};
+
+	struct Snapshot {
+		void prepare();
+
+		unsigned long tick = 0;
+		Player players[4] = {};
+		Entity entities[4] = {};
+		std::shared_ptr<const LevelView> level; // resident chunks, replaces the arena if set
+	};
+
+	static glm::mat3 look_at(glm::vec3 d);
+	glm::mat2 rotateXY(float a) const;
+	float sphere(glm::vec3 p, float r) const;
+	float roundcube(glm::vec3 p, glm::vec2 r) const;
+	float roundcube(glm::vec3 p, glm::vec4 r) const;
+	float cube(glm::vec3 p, float r) const;
+	float cube(glm::vec3 p, glm::vec3 r) const;
+	float quickcube(glm::vec3 p, float r) const;
+	float quickcube(glm::vec3 p, glm::vec3 r) const;
+	float plane(glm::vec3 p, glm::vec3 n, float r) const;
+	float line(glm::vec3 p, glm::vec3 a, glm::vec3 b, float r) const;
+	float torus(glm::vec3 p, glm::vec2 r) const;
+	float onion(float d, float thickness) const;
+	glm::vec3 alongate(glm::vec3 p, glm::vec3 a, glm::vec3 b) const;
+	Interval roundcube(Interval3 p, glm::vec4 r) const;
+	Interval quickcube(Interval3 p, glm::vec3 r) const;
+	Interval plane(Interval3 p, glm::vec3 n, float r) const;
+	float level_primitive(glm::vec3 p, const Level::Primitive& q) const;
+	float level_brick(glm::vec3 p, const Level::Brick& b, const std::vector<float>& samples) const;
+	float level_chunk(glm::vec3 p, glm::ivec3 coord, float d) const;
+	float level(glm::vec3 p) const;
+	float scene(glm::vec3 p) const;
+	float scene(glm::vec3 p, unsigned mask) const;
+	unsigned prune(glm::vec3 lo, glm::vec3 hi) const;
+	void prune_tile(glm::vec2 begin, glm::vec2 end, glm::vec2 output_size);
+	bool march(glm::vec3 ro, glm::vec3 rd, glm::vec3* p, float* steps) const;
+	glm::vec3 normal(glm::vec3 p) const;
+	glm::vec3 pixel(glm::vec2 output_coord, glm::vec2 output_size, glm::vec4* gbuffer) const;
+	bool edge(glm::vec4 a, glm::vec4 b) const;
+	glm::vec3 refine(glm::vec2 output_coord, glm::vec2 output_size, glm::vec3 c) const;
+
+	static constexpr float aa_depth_threshold = .1f;
+	static constexpr float aa_normal_threshold = .9f;
+
+	// terms of scene(), bits 0 to 3 are the players
+	static constexpr unsigned scene_box = 1u << 4;
+	static constexpr unsigned scene_floor = 1u << 5;
+	static constexpr unsigned scene_arena = scene_box | scene_floor;
+	static constexpr unsigned scene_level = 1u << 6;
+	static constexpr unsigned scene_all = 0xf | scene_arena | scene_level;
+
+	static constexpr int march_segments = 8;
+	static constexpr float march_distance = 20;
+
+	const Snapshot* snapshot = nullptr;
 
 	glm::ivec2 render_translation;
 	glm::ivec2 render_size;
@@ -30,14 +91,7 @@ public:
 	glm::vec3 camera_pos;
 	glm::vec3 camera_dir;
 	int camera_player;
-
-	struct Player {
-		glm::vec4 pos;
-		glm::vec4 dir;
-		glm::vec4 vel;
-	};
-
-	Player players[4];
+	unsigned march_masks[march_segments] = {scene_all, scene_all, scene_all, scene_all, scene_all, scene_all, scene_all, scene_all};
 
 private:
 };
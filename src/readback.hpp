@@ -0,0 +1,222 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * ring of pixel pack buffers to read images back from the gpu without stalling.
+ * request() only queues a copy into the next free buffer and places a fence behind it,
+ * update() copies every image whose fence has signaled into a bounded queue (oldest first),
+ * which a writer thread hands to the consumer. if all buffers are still in flight or the
+ * writer falls behind and the queue is full, the frame is dropped.
+ * destroying it waits for every requested copy to be written, so the gl context has to
+ * be current then
+ */
+class Readback {
+public:
+	using ConsumeF = std::function<void(const std::uint8_t* pixels, glm::uvec2 size, unsigned long frame, const std::string& name)>;
+
+	Readback(std::size_t count, std::size_t queue_capacity, ConsumeF consume_f)
+		: m_slots(count)
+		, m_consume_f(std::move(consume_f))
+		, m_queue_capacity(queue_capacity)
+		, m_writer([this] (std::stop_token stop_token) { write(stop_token); })
+	{
+		for (auto& slot : m_slots)
+			glCreateBuffers(1, &slot.buffer);
+	}
+
+	Readback(const Readback&) = delete;
+	Readback& operator= (const Readback&) = delete;
+
+	~Readback()
+	{
+		finish();
+		for (auto& slot : m_slots) {
+			if (slot.fence)
+				glDeleteSync(slot.fence);
+			glDeleteBuffers(1, &slot.buffer);
+		}
+	}
+
+	// queue an asynchronous copy of the texture. name is handed to the consumer with it.
+	// returns false if the frame was dropped
+	bool request(GLuint texture, glm::uvec2 size, unsigned long frame, std::string name)
+	{
+		if (m_in_flight == m_slots.size()) {
+			++m_dropped;
+			return false;
+		}
+
+		auto& slot = m_slots[(m_head + m_in_flight) % m_slots.size()];
+		auto bytes = static_cast<std::size_t>(size.x) * size.y * 4;
+		if (slot.capacity < bytes) {
+			glNamedBufferData(slot.buffer, bytes, nullptr, GL_STREAM_READ);
+			slot.capacity = bytes;
+		}
+
+		glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_PIXEL_BUFFER_BARRIER_BIT);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTextureImage(texture, 0, GL_RGBA, GL_UNSIGNED_BYTE, bytes, nullptr);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot.size = size;
+		slot.frame = frame;
+		slot.name = std::move(name);
+		++m_in_flight;
+		return true;
+	}
+
+	// queue every finished copy for the writer. never waits on the gpu or the writer
+	void update()
+	{
+		collect(false);
+	}
+
+	// wait for every requested copy and queue it, waiting for room in the queue instead of dropping
+	void finish()
+	{
+		if (m_in_flight == 0)
+			return;
+		glFinish();
+		collect(true);
+	}
+
+	std::size_t in_flight() const { return m_in_flight; }
+	unsigned long delivered() const { return m_delivered; }
+	unsigned long dropped() const { return m_dropped; }
+
+private:
+	struct Slot {
+		GLuint buffer = 0;
+		GLsync fence = nullptr;
+		std::size_t capacity = 0;
+		glm::uvec2 size;
+		unsigned long frame = 0;
+		std::string name;
+	};
+
+	struct Image {
+		std::vector<std::uint8_t> pixels;
+		glm::uvec2 size;
+		unsigned long frame;
+		std::string name;
+	};
+
+	void collect(bool wait)
+	{
+		while (m_in_flight > 0) {
+			auto& slot = m_slots[m_head];
+			auto status = glClientWaitSync(slot.fence, 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED)
+				break;
+
+			glDeleteSync(slot.fence);
+			slot.fence = nullptr;
+
+			if (status == GL_WAIT_FAILED) {
+				++m_dropped;
+			} else {
+				auto bytes = static_cast<std::size_t>(slot.size.x) * slot.size.y * 4;
+				auto pixels = glMapNamedBufferRange(slot.buffer, 0, bytes, GL_MAP_READ_BIT);
+				if (pixels && enqueue(static_cast<const std::uint8_t*>(pixels), bytes, slot, wait))
+					++m_delivered;
+				else
+					++m_dropped;
+				if (pixels)
+					glUnmapNamedBuffer(slot.buffer);
+			}
+
+			m_head = (m_head + 1) % m_slots.size();
+			--m_in_flight;
+		}
+	}
+
+	// copy the mapped pixels for the writer. false if its queue is full, unless wait is set
+	bool enqueue(const std::uint8_t* pixels, std::size_t bytes, const Slot& slot, bool wait)
+	{
+		{
+			auto lock = std::unique_lock(m_mutex);
+			if (wait)
+				m_dequeued.wait(lock, [this] { return m_queue.size() < m_queue_capacity; });
+			else if (m_queue.size() >= m_queue_capacity)
+				return false;
+
+			auto buffer = std::vector<std::uint8_t>();
+			if (!m_free.empty()) {
+				buffer = std::move(m_free.back());
+				m_free.pop_back();
+			}
+			buffer.assign(pixels, pixels + bytes);
+			m_queue.push_back({std::move(buffer), slot.size, slot.frame, slot.name});
+		}
+		m_condition.notify_one();
+		return true;
+	}
+
+	// consume queued images until stopped and the queue is empty
+	void write(std::stop_token stop_token)
+	{
+		auto lock = std::unique_lock(m_mutex);
+		while (m_condition.wait(lock, stop_token, [this] { return !m_queue.empty(); })) {
+			auto image = std::move(m_queue.front());
+			m_queue.pop_front();
+			m_dequeued.notify_one();
+			lock.unlock();
+			m_consume_f(image.pixels.data(), image.size, image.frame, image.name);
+			lock.lock();
+			m_free.push_back(std::move(image.pixels));
+		}
+	}
+
+	std::vector<Slot> m_slots;
+	ConsumeF m_consume_f;
+	std::size_t m_head = 0;
+	std::size_t m_in_flight = 0;
+	unsigned long m_delivered = 0;
+	unsigned long m_dropped = 0;
+
+	std::mutex m_mutex;
+	std::condition_variable_any m_condition;
+	std::condition_variable m_dequeued;
+	std::deque<Image> m_queue;
+	std::vector<std::vector<std::uint8_t>> m_free;
+	std::size_t m_queue_capacity;
+
+	std::jthread m_writer;
+};
+
+// write tightly packed rgba pixels (bottom row first, as read from gl) to a binary ppm
+static bool writePpm(const std::string& filepath, const std::uint8_t* pixels, glm::uvec2 size)
+{
+	std::ofstream fstream(filepath, std::ios::binary);
+	if (!fstream.is_open())
+	{
+		std::cout << "Unable to open file '" << filepath << "'" << std::endl;
+		return false;
+	}
+
+	fstream << "P6\n" << size.x << ' ' << size.y << "\n255\n";
+	auto row = std::vector<char>(size.x * 3);
+	for (auto y = size.y; y-- > 0;) {
+		auto src = pixels + static_cast<std::size_t>(y) * size.x * 4;
+		for (auto x = 0u; x < size.x; ++x)
+			for (auto c = 0u; c < 3; ++c)
+				row[x * 3 + c] = static_cast<char>(src[x * 4 + c]);
+		fstream.write(row.data(), row.size());
+	}
+
+	return true;
+}
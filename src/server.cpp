@@ -0,0 +1,47 @@
+#include "server.hpp"
+#include <cstring>
+
+Server::Server(unsigned thread_count)
+	: m_pool(thread_count)
+{
+}
+
+Server::Report Server::run(std::vector<Match>& matches, unsigned long ticks)
+{
+	auto input = InputSnapshot();
+	auto start = std::chrono::steady_clock::now();
+
+	m_pool.parallel(matches.size(), [&] (unsigned index) {
+		auto& match = matches[index];
+		auto samples = std::vector<PlayerInput::Sample>(match.inputs.size());
+		for (auto tick = 0ul; tick < ticks; ++tick) {
+			for (auto i = 0ul; i < match.inputs.size(); ++i)
+				samples[i] = match.inputs[i].sample(input);
+			match.simulation.step(samples);
+			if (match.recording)
+				match.recording->push_back(samples);
+		}
+	});
+
+	auto report = Report{
+		.ticks = ticks * matches.size(),
+		.duration = std::chrono::steady_clock::now() - start,
+		.thread_count = m_pool.thread_count(),
+	};
+
+	// fnv-1a over the bits of every player, in match order
+	report.checksum = 14695981039346656037ull;
+	for (auto& match : matches) {
+		for (auto& player : match.simulation.m_players) {
+			for (auto v : {player.m_pos, player.m_dir, player.m_vel}) {
+				for (auto i = 0; i < 3; ++i) {
+					std::uint32_t bits;
+					std::memcpy(&bits, &v[i], sizeof (bits));
+					report.checksum = (report.checksum ^ bits) * 1099511628211ull;
+				}
+			}
+		}
+	}
+
+	return report;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include "parallel.hpp"
+#include "playerinput.hpp"
+#include "simulation.hpp"
+
+/*
+ * runs many independent matches without a window or gl context, to load test the
+ * game logic and evaluate bots. every match is a Simulation with its own inputs,
+ * stepped tick after tick on the fixed timestep as fast as the cores allow.
+ * the threads of a pool pick up matches until none are left
+ */
+class Server {
+public:
+	struct Match {
+		Simulation simulation;
+		std::vector<PlayerInput> inputs;
+		PlayerInput::Recording* recording = nullptr; // receives the samples of every tick if set
+	};
+
+	struct Report {
+		unsigned long ticks = 0; // summed over all matches
+		std::chrono::nanoseconds duration = {};
+		unsigned thread_count = 0;
+		std::uint64_t checksum = 0; // of the final player states, equal for equal inputs
+	};
+
+	explicit Server(unsigned thread_count = 0);
+
+	Report run(std::vector<Match>& matches, unsigned long ticks);
+
+private:
+	ThreadPool m_pool;
+};
@@ -0,0 +1,38 @@
+#include "simulation.hpp"
+#include <iterator>
+
+Simulation::Simulation(std::vector<Player> players)
+	: m_players(std::move(players))
+{
+}
+
+void Simulation::step(const std::vector<PlayerInput::Sample>& inputs)
+{
+	for (auto i = 0ul; i < m_players.size(); ++i)
+		m_players[i].update(tick_duration, i < inputs.size() ? inputs[i] : PlayerInput::Sample{});
+	++m_tick;
+
+	if (m_streamer) {
+		auto positions = std::vector<glm::vec3>();
+		for (auto& player : m_players)
+			positions.push_back(player.m_pos);
+		m_streamer->update(positions);
+	}
+}
+
+void Simulation::snapshot(Rays::Snapshot& snapshot) const
+{
+	snapshot.tick = m_tick;
+	for (auto i = 0ul; i < std::size(snapshot.players); ++i) {
+		auto& player = snapshot.players[i];
+		if (i < m_players.size()) {
+			player.pos = glm::vec4(m_players[i].m_pos, 1);
+			player.dir = glm::vec4(m_players[i].m_dir, 1);
+			player.vel = glm::vec4(m_players[i].m_vel, 1);
+		} else {
+			player = Rays::Player{};
+		}
+	}
+	snapshot.level = m_streamer ? m_streamer->view() : nullptr;
+	snapshot.prepare();
+}
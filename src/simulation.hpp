@@ -0,0 +1,26 @@
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include "level.hpp"
+#include "player.hpp"
+#include "rays.hpp"
+
+/*
+ * the game logic, advanced in fixed ticks independently of the frame rate.
+ * after every step the state is copied into a Rays::Snapshot for the renderers,
+ * together with the per frame invariants the scene needs and the resident level
+ */
+class Simulation {
+public:
+	static constexpr auto tick_duration = std::chrono::milliseconds(16);
+
+	explicit Simulation(std::vector<Player> players);
+
+	void step(const std::vector<PlayerInput::Sample>& inputs);
+	void snapshot(Rays::Snapshot& snapshot) const;
+
+	std::vector<Player> m_players;
+	unsigned long m_tick = 0;
+	Streamer* m_streamer = nullptr;
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+
+/*
+ * lock-free single producer single consumer triple buffer.
+ * the writer fills back() and publishes it, the reader picks up the most recently
+ * published value with update() and reads it through front(). neither side ever waits,
+ * values the reader did not pick up in time are overwritten
+ */
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() = default;
+
+	explicit TripleBuffer(const T& value)
+		: m_buffers{value, value, value}
+	{
+	}
+
+	// writer side. the back buffer holds stale data and has to be rewritten completely
+	T& back() { return m_buffers[m_back]; }
+
+	void publish()
+	{
+		m_back = m_middle.exchange(m_back | fresh_bit, std::memory_order_acq_rel) & index_mask;
+	}
+
+	// reader side. returns true if a newer value was published since the last update
+	bool update()
+	{
+		if (!(m_middle.load(std::memory_order_relaxed) & fresh_bit))
+			return false;
+		m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & index_mask;
+		return true;
+	}
+
+	const T& front() const { return m_buffers[m_front]; }
+
+private:
+	static constexpr unsigned index_mask = 3;
+	static constexpr unsigned fresh_bit = 4;
+
+	std::array<T, 3> m_buffers;
+	unsigned m_back = 0;
+	alignas(64) std::atomic<unsigned> m_middle = 1;
+	alignas(64) unsigned m_front = 2;
+};